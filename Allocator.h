@@ -11,59 +11,2317 @@
 // includes
 // --------
 
+#include <algorithm> // min
+#include <atomic>    // atomic
 #include <cassert>   // assert
 #include <cstddef>   // ptrdiff_t, size_t
+#include <cstdint>   // int16_t, int32_t, uint16_t, uint32_t
+#include <cstring>   // memcpy
+#include <limits>    // numeric_limits
+#include <memory>    // unique_ptr
+#include <mutex>     // lock_guard, mutex
 #include <new>       // bad_alloc, new
+#include <ostream>   // ostream
 #include <stdexcept> // invalid_argument
+#include <thread>    // this_thread, thread
+#include <type_traits> // conditional
+#include <utility>   // forward
 #include <typeinfo>
+#include <sys/mman.h> // mmap, munmap
 #include "gtest/gtest_prod.h"
 
 using namespace std;
 
+// ---------
+// first_fit
+// ---------
+
+/**
+ * placement policy, one free list in LIFO order, allocate() takes the
+ * first free block on it that fits
+ * a placement policy keeps the free blocks of an Allocator, insert()
+ * and remove() are called as blocks become free or busy, find() returns
+ * the index of a free block with a payload of at least size, or -1, and
+ * calls visit() on every block it looks at
+ */
+struct first_fit {
+    int head;
+
+    first_fit () :
+            head (-1)
+        {}
+
+    template <typename A>
+    void insert (A& x, int i) {
+        x.link(head, i);}
+
+    template <typename A>
+    void remove (A& x, int i) {
+        x.unlink(head, i);}
+
+    /**
+     * O(1) in space
+     * O(f) in time, f the number of free blocks
+     */
+    template <typename A>
+    int find (const A& x, int size) const {
+        for (int i = head; i != -1; i = x.next_link(i)) {
+            x.visit();
+            if (x.size(i) >= size)
+                return i;}
+        return -1;}
+
+    /**
+     * number of free blocks linked, -1 if the links are broken
+     */
+    template <typename A>
+    int count (const A& x) const {
+        return x.count_list(head);}};
+
+// --------
+// next_fit
+// --------
+
+/**
+ * placement policy, one free list, allocate() takes the first free block
+ * that fits starting at a roving cursor and wrapping around to the head,
+ * so small blocks do not pile up at the front of the list
+ * the cursor survives across calls, the tail split off the block of the
+ * last allocation is put on the list at the cursor and becomes it, so
+ * the next search picks up where the last one stopped, when the block
+ * at the cursor leaves the list, coalesced by deallocate() or handed out
+ * whole, the cursor moves to the next block on the list
+ */
+struct next_fit {
+    int head;
+    int rover;
+    int last;
+
+    next_fit () :
+            head  (-1),
+            rover (-1),
+            last  (-1)
+        {}
+
+    /**
+     * O(1) in space
+     * O(1) in time
+     */
+    template <typename A>
+    void insert (A& x, int i) {
+        if ((last != -1) && !x.is_free(last) && (i == x.next_block(last))) {
+            last = -1;
+            if ((rover != -1) && (x.prev_link(rover) != -1)) {
+                const int prev = x.prev_link(rover);
+                x.link(x.next_link(prev), i);
+                x.prev_link(i) = prev;}
+            else
+                x.link(head, i);
+            rover = i;}
+        else
+            x.link(head, i);}
+
+    template <typename A>
+    void remove (A& x, int i) {
+        if (i == rover)
+            rover = x.next_link(i);
+        x.unlink(head, i);}
+
+    /**
+     * O(1) in space
+     * O(f) in time, f the number of free blocks
+     */
+    template <typename A>
+    int find (const A& x, int size) {
+        const int start = (rover == -1) ? head : rover;
+        int i = start;
+        while (i != -1) {
+            x.visit();
+            if (x.size(i) >= size)
+                return rover = last = i;
+            i = x.next_link(i);
+            if (i == -1)
+                i = head;
+            if (i == start)
+                break;}
+        return -1;}
+
+    template <typename A>
+    int count (const A& x) const {
+        return x.count_list(head);}};
+
+// --------
+// best_fit
+// --------
+
+/**
+ * placement policy, one free list in LIFO order, allocate() takes the
+ * smallest free block that fits, stopping early on an exact fit
+ */
+struct best_fit {
+    int head;
+
+    best_fit () :
+            head (-1)
+        {}
+
+    template <typename A>
+    void insert (A& x, int i) {
+        x.link(head, i);}
+
+    template <typename A>
+    void remove (A& x, int i) {
+        x.unlink(head, i);}
+
+    /**
+     * O(1) in space
+     * O(f) in time, f the number of free blocks
+     */
+    template <typename A>
+    int find (const A& x, int size) const {
+        int best = -1;
+        for (int i = head; i != -1; i = x.next_link(i)) {
+            x.visit();
+            if ((x.size(i) >= size) && ((best == -1) || (x.size(i) < x.size(best)))) {
+                best = i;
+                if (x.size(i) == size)
+                    break;}}
+        return best;}
+
+    template <typename A>
+    int count (const A& x) const {
+        return x.count_list(head);}};
+
+// --------------
+// segregated_fit
+// --------------
+
+/**
+ * placement policy, two level segregated fit (TLSF)
+ * free blocks are kept in one list per size class, the first level
+ * splits sizes by powers of two, the second level splits every power
+ * of two in sl_count linear classes, sizes below small_size are split
+ * linearly in classes 4 bytes wide
+ * a bit per non empty class makes find() two find-first-set
+ * instructions, so allocate() and deallocate() are O(1) whatever N or
+ * the fragmentation of the pool are
+ * a request is rounded up to the next class so any block found fits,
+ * only when that fails the head of the class of the request is tried
+ */
+struct segregated_fit {
+    static const int sl_log2    = 3;
+    static const int sl_count   = 1 << sl_log2;
+    static const int fl_shift   = sl_log2 + 2;
+    static const int fl_count   = 32 - fl_shift;
+    static const int small_size = 1 << fl_shift;
+
+    unsigned fl_bitmap;
+    unsigned sl_bitmap[fl_count];
+    int      bins[fl_count][sl_count];
+
+    segregated_fit () :
+            fl_bitmap (0) {
+        for (int fl = 0; fl != fl_count; ++fl) {
+            sl_bitmap[fl] = 0;
+            for (int sl = 0; sl != sl_count; ++sl)
+                bins[fl][sl] = -1;}}
+
+    /**
+     * O(1) in space
+     * O(1) in time
+     * size class of a block with a payload of size
+     */
+    static void mapping (int size, int& fl, int& sl) {
+        if (size < small_size) {
+            fl = 0;
+            sl = size / (small_size / sl_count);}
+        else {
+            const int f = 31 - __builtin_clz(size);
+            fl = f - fl_shift + 1;
+            sl = (size >> (f - sl_log2)) ^ sl_count;}}
+
+    /**
+     * O(1) in space
+     * O(1) in time
+     * first size class whose blocks all have a payload of at least size
+     */
+    static void mapping_search (int size, int& fl, int& sl) {
+        if (size < small_size)
+            size = size + (small_size / sl_count) - 1;
+        else
+            size = size + (1 << (31 - __builtin_clz(size) - sl_log2)) - 1;
+        mapping(size, fl, sl);}
+
+    template <typename A>
+    void insert (A& x, int i) {
+        int fl, sl;
+        mapping(x.size(i), fl, sl);
+        x.link(bins[fl][sl], i);
+        fl_bitmap     |= 1u << fl;
+        sl_bitmap[fl] |= 1u << sl;}
+
+    template <typename A>
+    void remove (A& x, int i) {
+        int fl, sl;
+        mapping(x.size(i), fl, sl);
+        x.unlink(bins[fl][sl], i);
+        if (bins[fl][sl] == -1) {
+            sl_bitmap[fl] &= ~(1u << sl);
+            if (sl_bitmap[fl] == 0)
+                fl_bitmap &= ~(1u << fl);}}
+
+    /**
+     * O(1) in space
+     * O(1) in time
+     */
+    template <typename A>
+    int find (const A& x, int size) const {
+        int fl, sl;
+        mapping_search(size, fl, sl);
+        if (fl < fl_count) {
+            unsigned sl_map = sl_bitmap[fl] & (~0u << sl);
+            if (sl_map == 0) {
+                const unsigned fl_map = (fl + 1 < fl_count) ? (fl_bitmap & (~0u << (fl + 1))) : 0;
+                if (fl_map != 0) {
+                    fl     = __builtin_ctz(fl_map);
+                    sl_map = sl_bitmap[fl];}}
+            if (sl_map != 0) {
+                x.visit();
+                return bins[fl][__builtin_ctz(sl_map)];}}
+        mapping(size, fl, sl);
+        const int i = bins[fl][sl];
+        if (i == -1)
+            return -1;
+        x.visit();
+        return (x.size(i) >= size) ? i : -1;}
+
+    /**
+     * number of free blocks linked, -1 if the links are broken, a block
+     * is on the list of the wrong class, or a bitmap is out of date
+     */
+    template <typename A>
+    int count (const A& x) const {
+        int total = 0;
+        for (int fl = 0; fl != fl_count; ++fl) {
+            if (((fl_bitmap >> fl) & 1u) != (sl_bitmap[fl] != 0))
+                return -1;
+            for (int sl = 0; sl != sl_count; ++sl) {
+                if (((sl_bitmap[fl] >> sl) & 1u) != (bins[fl][sl] != -1))
+                    return -1;
+                const int n = x.count_list(bins[fl][sl]);
+                if (n == -1)
+                    return -1;
+                for (int i = bins[fl][sl]; i != -1; i = x.next_link(i)) {
+                    int f, s;
+                    mapping(x.size(i), f, s);
+                    if ((f != fl) || (s != sl))
+                        return -1;}
+                total += n;}}
+        return total;}};
+
+// -----------
+// check_none
+// -----------
+
+/**
+ * checking policy, no integrity checks at all
+ * a checking policy is called with the Allocator and the index of the
+ * front sentinel of the block an operation touched, -1 if it is not
+ * known, as construct() and destroy() may get a pointer inside a block,
+ * and returns false if it found the pool corrupted
+ */
+struct check_none {
+    template <typename A>
+    bool operator () (const A&, int) {
+        return true;}};
+
+// -----------
+// check_local
+// -----------
+
+/**
+ * checking policy, O(1) checks of the sentinels of the block an
+ * operation touched and of its neighbours, and of its free list links
+ */
+struct check_local {
+    template <typename A>
+    bool operator () (const A& x, int i) {
+        return (i == -1) || x.valid_block(i);}};
+
+// -------------
+// check_sampled
+// -------------
+
+/**
+ * checking policy, a full valid() every K operations, O(n / K) in time
+ * amortized per operation
+ */
+template <int K>
+struct check_sampled {
+    int operations;
+
+    check_sampled () :
+            operations (0)
+        {}
+
+    template <typename A>
+    bool operator () (const A& x, int) {
+        if (++operations < K)
+            return true;
+        operations = 0;
+        return x.valid();}};
+
+// ----------
+// check_full
+// ----------
+
+/**
+ * checking policy, a full valid() on every operation, O(n) in time
+ */
+struct check_full {
+    template <typename A>
+    bool operator () (const A& x, int) {
+        return x.valid();}};
+
+/**
+ * full checks in debug builds, none when NDEBUG is defined, as the
+ * assert(valid()) it replaces
+ */
+#ifdef NDEBUG
+typedef check_none  default_check;
+#else
+typedef check_full  default_check;
+#endif
+
+// ----------
+// heap_stats
+// ----------
+
+/**
+ * statistics of a heap, from statistics()
+ * scans[0] counts the allocations that looked at no block, scans[k] the
+ * ones that looked at 2^(k - 1) to 2^k - 1 blocks, the last one all the
+ * longer ones
+ */
+struct heap_stats {
+    static const int buckets = 16;
+
+    long   allocations;
+    long   frees;
+    long   bytes_in_use;
+    long   high_water;
+    int    free_blocks;
+    int    largest_free;
+    double fragmentation;
+    long   scans[buckets];};
+
+// --------
+// no_stats
+// --------
+
+/**
+ * statistics policy, nothing is counted, an empty base of the heap, so
+ * it costs neither space nor time
+ * a statistics policy is told of every block find() visits, of the end
+ * of every scan, and of the payload of every block handed out, given
+ * back, or resized
+ */
+struct no_stats {
+    void visit () const {}
+
+    void scanned () {}
+
+    void allocated (int) {}
+
+    void deallocated (int) {}
+
+    void resized (int, int) {}};
+
+// --------------
+// counting_stats
+// --------------
+
+/**
+ * statistics policy, counts allocations and frees, the payload bytes of
+ * busy blocks and their high water mark, and the blocks every scan of
+ * allocate() visits, O(1) in time per operation
+ */
+struct counting_stats {
+    long        allocations;
+    long        frees;
+    long        bytes_in_use;
+    long        high_water;
+    long        scans[heap_stats::buckets];
+    mutable int visited;
+
+    counting_stats () :
+            allocations  (0),
+            frees        (0),
+            bytes_in_use (0),
+            high_water   (0),
+            visited      (0) {
+        for (int k = 0; k != heap_stats::buckets; ++k)
+            scans[k] = 0;}
+
+    void visit () const {
+        ++visited;}
+
+    void scanned () {
+        const int k = (visited == 0) ? 0 : 32 - __builtin_clz(visited);
+        ++scans[k < heap_stats::buckets ? k : heap_stats::buckets - 1];
+        visited = 0;}
+
+    void allocated (int bytes) {
+        ++allocations;
+        resized(0, bytes);}
+
+    void deallocated (int bytes) {
+        ++frees;
+        bytes_in_use -= bytes;}
+
+    void resized (int from, int to) {
+        bytes_in_use += to - from;
+        if (bytes_in_use > high_water)
+            high_water = bytes_in_use;}
+
+    void snapshot (heap_stats& r) const {
+        r.allocations  = allocations;
+        r.frees        = frees;
+        r.bytes_in_use = bytes_in_use;
+        r.high_water   = high_water;
+        for (int k = 0; k != heap_stats::buckets; ++k)
+            r.scans[k] = scans[k];}};
+
+/**
+ * counting when ALLOCATOR_STATS is defined, nothing otherwise
+ */
+#ifdef ALLOCATOR_STATS
+typedef counting_stats default_stats;
+#else
+typedef no_stats       default_stats;
+#endif
+
+// -------------
+// boundary_tags
+// -------------
+
+/**
+ * block layout, an int front sentinel and back sentinel on every block
+ * holding the size of its payload, positive if the block is free,
+ * negative if it is busy, 8 bytes a block whatever N is
+ * a block layout tells the heap where the tags of the block at i are
+ * and what they hold, the heap only walks blocks through it
+ */
+struct boundary_tags {
+    typedef int tag;
+    typedef int link;
+
+    static const bool footers   = true;                // every block has a back tag
+    static const int  header    = sizeof(int);         // bytes in front of the payload
+    static const int  overhead  = 2 * sizeof(int);     // bytes of a block outside its payload
+    static const int  min_free  = 2 * sizeof(int);     // payload a free block needs for its links
+    static const int  min_align = sizeof(int);
+    static const std::size_t capacity = std::numeric_limits<int>::max(); // biggest pool the tags and links can index
+
+    static int& at (char* a, int i) {
+        return *reinterpret_cast<int*>(a + i);}
+
+    static int at (const char* a, int i) {
+        return *reinterpret_cast<const int*>(a + i);}
+
+    static int size (const char* a, int i) {
+        const int sentinel = at(a, i);
+        return sentinel < 0 ? (-1 * sentinel) : sentinel;}
+
+    static bool is_free (const char* a, int i) {
+        return at(a, i) > 0;}
+
+    static bool prev_free (const char* a, int i) {
+        return at(a, i - sizeof(int)) > 0;}
+
+    static int prev_block (const char* a, int i) {
+        const int sentinel = at(a, i - sizeof(int));
+        return i - overhead - (sentinel < 0 ? (-1 * sentinel) : sentinel);}
+
+    static bool tags_match (const char* a, int i) {
+        return at(a, i) == at(a, i + header + size(a, i));}
+
+    static void set_free (char* a, int i, int n, int) {
+        at(a, i) = at(a, i + header + n) = n;}
+
+    static void set_busy (char* a, int i, int n, bool, int) {
+        at(a, i) = at(a, i + header + n) = (-1 * n);}};
+
+// ------------
+// compact_tags
+// ------------
+
+/**
+ * block layout for a pool of N bytes, the front tag is as narrow as N
+ * allows, 2 bytes below 64K, 4 bytes above, and holds the length of the
+ * block with two flags in its low bits, busy, and free before, set when
+ * the block right before it is free
+ * only free blocks keep a back tag, in the last bytes of their payload,
+ * a busy block has no footer, deallocate() learns from the free before
+ * flag whether there is a back tag to find the block before it with
+ * blocks are a multiple of 4 long, so the flags never hide a length,
+ * and the free list links are as narrow as the tags
+ * a pool of more than capacity bytes, N or more, can not be indexed
+ */
+template <std::size_t N>
+struct compact_tags {
+    typedef typename std::conditional<(N < 65536), std::uint16_t, std::uint32_t>::type tag;
+    typedef typename std::conditional<(N < 32768), std::int16_t,  std::int32_t>::type  link;
+
+    static const bool footers   = false;
+    static const int  header    = sizeof(tag);
+    static const int  overhead  = sizeof(tag);
+    static const int  min_free  = (2 * sizeof(link)) + sizeof(tag);
+    static const int  min_align = 4;
+    static const std::size_t capacity = static_cast<std::size_t>(std::numeric_limits<link>::max()) < std::numeric_limits<tag>::max() ?
+                                        std::numeric_limits<link>::max() : std::numeric_limits<tag>::max();
+
+    static const tag busy_bit      = 1;
+    static const tag prev_free_bit = 2;
+
+    static tag& at (char* a, int i) {
+        return *reinterpret_cast<tag*>(a + i);}
+
+    static tag at (const char* a, int i) {
+        return *reinterpret_cast<const tag*>(a + i);}
+
+    static int length (const char* a, int i) {
+        return at(a, i) & ~(busy_bit | prev_free_bit);}
+
+    static int size (const char* a, int i) {
+        return length(a, i) - header;}
+
+    static bool is_free (const char* a, int i) {
+        return (at(a, i) & busy_bit) == 0;}
+
+    static bool prev_free (const char* a, int i) {
+        return (at(a, i) & prev_free_bit) != 0;}
+
+    static int prev_block (const char* a, int i) {
+        return i - at(a, i - sizeof(tag));}
+
+    static bool tags_match (const char* a, int i) {
+        return !is_free(a, i) || (static_cast<int>(at(a, i + length(a, i) - sizeof(tag))) == length(a, i));}
+
+    static void set_free (char* a, int i, int n, int limit) {
+        const int block = n + header;
+        at(a, i) = at(a, i + block - sizeof(tag)) = block;
+        if (i + block < limit)
+            at(a, i + block) |= prev_free_bit;}
+
+    static void set_busy (char* a, int i, int n, bool after_free, int limit) {
+        const int block = n + header;
+        at(a, i) = block | busy_bit | (after_free ? prev_free_bit : 0);
+        if (i + block < limit)
+            at(a, i + block) &= ~prev_free_bit;}};
+
+// ----
+// Heap
+// ----
+
+/**
+ * boundary tag heap over the bytes of D, a pool of blocks laid out by L,
+ * by default each with an int front sentinel and back sentinel holding
+ * the size of its payload, positive if the block is free, negative if it
+ * is busy
+ * D owns the bytes and gives them with data(), then lays out the pool
+ * with init(), so the same heap runs inside an Allocator, over a fixed
+ * buffer, or over memory sized at run time
+ * every payload starts on a multiple of A, but never less than the
+ * alignment of the tags
+ * S is an empty base with no_stats, so the statistics are free when
+ * they are not counted
+ */
+template <typename D, std::size_t A, typename P, typename C, typename L = boundary_tags, typename S = default_stats>
+class Heap : private S {
+    public:
+        /**
+         * block layout, so a slab layer on top knows the overhead of a block
+         */
+        typedef L layout;
+
+        // --------
+        // contains
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * whether p points inside the pool
+         */
+        bool contains (const char* p) const {
+            return (p >= base()) && (p < base() + limit);}
+
+        // -------------
+        // fragmentation
+        // -------------
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * external fragmentation of the pool, 1 - (largest free payload /
+         * total free payload), 0 when all the free space is in one block,
+         * close to 1 when it is scattered in many small ones
+         * compare it across placement policies on the same workload
+         */
+        double fragmentation () const {
+            int total   = 0;
+            int largest = 0;
+            for (int i = first; i < limit; i = next_block(i)) {
+                if (is_free(i)) {
+                    total += size(i);
+                    if (size(i) > largest)
+                        largest = size(i);
+                }
+            }
+            return total == 0 ? 0.0 : 1.0 - (static_cast<double>(largest) / total);}
+
+        // ----------
+        // statistics
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * the counters of S, which must count, with the number of free
+         * blocks, the largest free payload, and fragmentation(), from a
+         * walk of the blocks
+         */
+        heap_stats statistics () const {
+            heap_stats r;
+            S::snapshot(r);
+            r.free_blocks  = 0;
+            r.largest_free = 0;
+            for (int i = first; i < limit; i = next_block(i)) {
+                if (is_free(i)) {
+                    ++r.free_blocks;
+                    if (size(i) > r.largest_free)
+                        r.largest_free = size(i);
+                }
+            }
+            r.fragmentation = fragmentation();
+            return r;}
+
+        // ----
+        // dump
+        // ----
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * write the block map, one line per block, from the walk valid()
+         * does, the index of its front tag, busy or free, and its payload
+         */
+        void dump (std::ostream& out) const {
+            for (int i = first; i < limit; i = next_block(i))
+                out << i << (is_free(i) ? " free " : " busy ") << size(i) << "\n";}
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * public [] operator, it is inmutable. We don't want anybody
+         * changes [] operator. 
+         */
+        const typename L::tag& operator [] (int i) const {
+            return *reinterpret_cast<const typename L::tag*>(base() + i);}
+
+    protected:
+        // ----
+        // data
+        // ----
+
+        /**
+         * placement policy keeping the free blocks
+         * free blocks are doubly linked through their own payload, the
+         * next index is stored at the start of the payload and the prev
+         * index right after it, so allocate() never visits a busy block
+         */
+        P free_list;
+
+        /**
+         * checking policy run at the end of every operation
+         */
+        C check;
+
+        friend P;
+        friend C;
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * tell the statistics policy find() looked at one more block
+         */
+        void visit () const {
+            S::visit();}
+
+        /**
+         * every payload starts on a multiple of align, so blocks are a
+         * multiple of align long
+         */
+        static const int align = A < static_cast<std::size_t>(L::min_align) ? L::min_align : A;
+
+        /**
+         * index of the front tag of the first block, so its payload
+         * starts at align
+         */
+        static const int first = align - L::header;
+
+        /**
+         * smallest payload a block may have, enough to hold the two links
+         * of the free list, and the back tag of a layout that keeps it in
+         * the payload, once the block is deallocated
+         */
+        static const int min_payload = ((((L::min_free + L::overhead) + align - 1) / align) * align) - L::overhead;
+
+        /**
+         * index one past the last block, the bytes after it are too few
+         * for a block
+         */
+        int limit;
+
+        char* base () {
+            return static_cast<D*>(this)->data();}
+
+        const char* base () const {
+            return static_cast<const D*>(this)->data();}
+
+        typename L::tag& operator [] (int i) {
+            return *reinterpret_cast<typename L::tag*>(base() + i);}
+
+        // ------
+        // blocks
+        // ------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * the block whose front tag is at i, as the layout reads it
+         * prev_block() is only known when prev_free(), or when the layout
+         * has footers
+         */
+        int size (int i) const {
+            return L::size(base(), i);}
+
+        bool is_free (int i) const {
+            return L::is_free(base(), i);}
+
+        bool tags_match (int i) const {
+            return L::tags_match(base(), i);}
+
+        int next_block (int i) const {
+            return i + L::overhead + size(i);}
+
+        bool prev_free (int i) const {
+            return L::prev_free(base(), i);}
+
+        int prev_block (int i) const {
+            return L::prev_block(base(), i);}
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * write the tags of a free or busy block at i with a payload of n,
+         * and tell the block after it, after_free is whether the block
+         * before a busy one is free
+         */
+        void set_free (int i, int n) {
+            L::set_free(base(), i, n, limit);}
+
+        void set_busy (int i, int n, bool after_free) {
+            L::set_busy(base(), i, n, after_free, limit);}
+
+        // ------------
+        // constructors
+        // ------------
+
+        Heap () :
+                limit (first)
+            {}
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * lay out one free block over the size bytes of D, the first block
+         * starts at first so its payload is aligned, the pool ends at limit
+         * so the last one is a multiple of align long
+         * throw a bad_alloc exception, if size is less than the block of a
+         * payload of smallest bytes, or if the indices do not fit in an int,
+         * or in the tags and links of L
+         */
+        void init (std::size_t size, std::size_t smallest) {
+
+            if ((size > static_cast<std::size_t>(std::numeric_limits<int>::max())) || (size > L::capacity))
+                throw bad_alloc();
+            limit = size < static_cast<std::size_t>(first) ? first : first + (((size - first) / align) * align);
+
+            if (limit - first < (payload(smallest) + L::overhead))
+                throw bad_alloc();
+            set_free(first, limit - first - L::overhead);
+            free_list.insert(*this, first);
+
+            verify(first);}
+
+        // -----
+        // valid
+        // -----
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * Check that the tags of every block match, that every block is a
+         * multiple of align long, that no two free blocks are adjacent, that
+         * every block knows whether the one before it is free, and that
+         * the free list links exactly the free blocks found on the walk
+         */
+        bool valid () const {
+
+            int free_blocks = 0;
+            bool after_free = false;
+            int i = first;
+
+            while (i < limit) {
+                const int s = size(i);
+                if ((s <= 0) || (((s + L::overhead) % align) != 0) || (i + s > limit - L::overhead))
+                    return false;
+                if (!tags_match(i) || ((i > first) && (prev_free(i) != after_free)))
+                    return false;
+                if (is_free(i)) {
+                    if (after_free)
+                        return false;
+                    ++free_blocks;
+                }
+                after_free = is_free(i);
+                i = next_block(i);
+            }
+
+            return free_list.count(*this) == free_blocks;}
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Check the block whose front tag is at i, its tags match, so do
+         * the ones of the blocks right after it, and right before it when
+         * they can be found, a free block has no free neighbour, and its
+         * free list links point back at it
+         */
+        bool valid_block (int i) const {
+            if ((i < first) || (i > limit - L::overhead) || (((i - first) % align) != 0))
+                return false;
+
+            const int s = size(i);
+
+            if ((s <= 0) || (((s + L::overhead) % align) != 0) ||
+                (i + s > limit - L::overhead) || !tags_match(i))
+                return false;
+
+            if ((i > first) && (L::footers || prev_free(i))) {
+                const int prev = prev_block(i);
+                if ((prev < first) || (next_block(prev) != i) || !tags_match(prev) ||
+                    (prev_free(i) != is_free(prev)) || (is_free(i) && is_free(prev)))
+                    return false;
+            }
+
+            const int next = next_block(i);
+
+            if (next < limit) {
+                if ((next + size(next) > limit - L::overhead) || !tags_match(next) ||
+                    (prev_free(next) != is_free(i)) || (is_free(i) && is_free(next)))
+                    return false;
+            }
+
+            if (is_free(i)) {
+                const int after  = next_link(i);
+                const int before = prev_link(i);
+                if ((after != -1) && ((after < first) || (after > limit - L::overhead) ||
+                                      !is_free(after) || (prev_link(after) != i)))
+                    return false;
+                if ((before != -1) && ((before < first) || (before > limit - L::overhead) ||
+                                       !is_free(before) || (next_link(before) != i)))
+                    return false;
+            }
+            return true;}
+
+        /**
+         * O(1) in space
+         * O(1) in time with check_none and check_local, O(n) with
+         * check_full, O(n / K) amortized with check_sampled<K>
+         * run the checking policy on the block at i, -1 if not known
+         * throw a logic_error exception, if the pool is corrupted
+         */
+        void verify (int i) {
+            if (!check(*this, i))
+                throw logic_error("Corrupted pool - Sentinels do not match");}
+
+        // ---------
+        // free list
+        // ---------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * links stored in the payload of the free block whose front tag is at i
+         */
+        typename L::link& next_link (int i) {
+            return *reinterpret_cast<typename L::link*>(base() + i + L::header);}
+
+        int next_link (int i) const {
+            return *reinterpret_cast<const typename L::link*>(base() + i + L::header);}
+
+        typename L::link& prev_link (int i) {
+            return *reinterpret_cast<typename L::link*>(base() + i + L::header + sizeof(typename L::link));}
+
+        int prev_link (int i) const {
+            return *reinterpret_cast<const typename L::link*>(base() + i + L::header + sizeof(typename L::link));}
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * push the free block at i on the front of the free list at head
+         */
+        template <typename H>
+        void link (H& head, int i) {
+            next_link(i) = head;
+            prev_link(i) = -1;
+            if (head != -1)
+                prev_link(head) = i;
+            head = i;}
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * splice the free block at i out of the free list at head
+         */
+        template <typename H>
+        void unlink (H& head, int i) {
+            const int next = next_link(i);
+            const int prev = prev_link(i);
+            if (prev != -1)
+                next_link(prev) = next;
+            else
+                head = next;
+            if (next != -1)
+                prev_link(next) = prev;}
+
+        /**
+         * O(1) in space
+         * O(f) in time, f the number of free blocks on the list
+         * length of the free list at head, -1 if a block on it is busy or
+         * its links do not match
+         */
+        int count_list (int head) const {
+            int n = 0;
+            int prev = -1;
+            for (int i = head; i != -1; i = next_link(i)) {
+                if ((++n > limit) || !is_free(i) || (prev_link(i) != prev))
+                    return -1;
+                prev = i;}
+            return n;}
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * payload of the block that holds bytes, never less than
+         * min_payload, and rounded up so the block is a multiple of align
+         */
+        static int payload (std::size_t bytes) {
+            const int data = ((((bytes + L::overhead + align - 1) / align) * align) - L::overhead);
+            return data < min_payload ? min_payload : data;}
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * hand out the block at i, off the free list, for a payload of data
+         * if what would be left after the split can not hold a free block,
+         * hand out the whole block instead
+         * after_free is whether the block before it is free, which only
+         * happens when allocate_bytes() split off alignment padding
+         */
+        void take (int i, int data, bool after_free = false) {
+            const int s    = size(i);
+            const int left = s - data - L::overhead;
+            if (left >= min_payload) {
+                set_busy(i, data, after_free);
+                set_free(i + L::overhead + data, left);
+                free_list.insert(*this, i + L::overhead + data);
+            }
+            else
+                set_busy(i, s, after_free);}
+
+        // --------------
+        // allocate_bytes
+        // --------------
+
+        /**
+         * O(1) in space
+         * O(f) in time with first_fit, next_fit and best_fit, f the number
+         * of free blocks
+         * O(1) in time with segregated_fit
+         * after allocation there must be enough space left for a valid block
+         * the smallest allowable block is min_payload + L::overhead
+         * the placement policy chooses a free block that fits, if what would
+         * be left after the split can not hold a free block, hand out the
+         * whole block instead
+         * a payload on a multiple of alignment bigger than align, a power of
+         * two, such as 32 or 64 for vector types or a cache line, asks the
+         * placement policy for a block big enough for the payload after the
+         * worst padding, if the payload of the block is not on a multiple of
+         * alignment, the padding in front is split off as a free block,
+         * which needs min_payload + L::overhead bytes, so padding too small
+         * for one grows by alignment until it is not, the worst padding is
+         * less than alignment + min_payload + L::overhead
+         * return 0 if no free block fits
+         * throw a bad_alloc exception, if the block does not pass the check
+         * of its tags
+         * throw an invalid_argument exception, if alignment is not a power
+         * of two
+         */
+        char* allocate_bytes (std::size_t bytes, std::size_t alignment) {
+
+            if ((alignment == 0) || ((alignment & (alignment - 1)) != 0))
+                throw invalid_argument("Invalid alignment - Alignment is not a power of two");
+
+            if ((bytes == 0) || (bytes > static_cast<std::size_t>(limit)))
+                return 0;
+
+            const int data_space_needed = payload(bytes);
+            const int worst_padding = alignment <= static_cast<std::size_t>(align) ? 0 : alignment + min_payload + L::overhead;
+            int i = free_list.find(*this, data_space_needed + worst_padding);
+            S::scanned();
+
+            if (i == -1)
+                return 0;
+
+            if (!tags_match(i))
+                throw bad_alloc();
+
+            free_list.remove(*this, i);
+
+            const std::size_t address = reinterpret_cast<std::size_t>(base() + i + L::header);
+            int padding = ((address + alignment - 1) & ~(alignment - 1)) - address;
+            if (padding != 0) {
+                while (padding < min_payload + L::overhead)
+                    padding += alignment;
+                set_free(i + padding, size(i) - padding);
+                set_free(i, padding - L::overhead);
+                free_list.insert(*this, i);
+                i = i + padding;
+            }
+            take(i, data_space_needed, padding != 0);
+            S::allocated(size(i));
+
+            verify(i);
+            return base() + i + L::header;}
+
+        // ----------
+        // busy_block
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * index of the front tag of the busy block whose payload starts at p
+         * throw an invalid_argument exception, if p is not inside the pool,
+         * not the payload of a busy block, or a block already coalesced
+         * into the free block before it
+         */
+        int busy_block (const char* p) const {
+            const char* a = base();
+
+            if ((p < a + first + L::header) || (p > a + limit - L::overhead))
+                throw invalid_argument("Invalid pointer - Pointer is not inside pool");
+
+            const int front = (p - a) - L::header;
+
+            if ((((front - first) % align) != 0) || is_free(front) || (size(front) <= 0) ||
+                (((size(front) + L::overhead) % align) != 0) || (next_block(front) > limit) || !tags_match(front) ||
+                ((front > first) && prev_free(front) && (next_block(prev_block(front)) != front)))
+                throw invalid_argument("Invalid pointer - Pointer is not valid starting address block");
+            return front;}
+
+        // ----------------
+        // deallocate_bytes
+        // ----------------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * after deallocation adjacent free blocks must be coalesced
+         * throw an invalid_argument exception, if p is invalid
+         * deallocate memory starting on the pointer passed to the method
+         * get the block to deallocate from the front tag in front of the
+         * pointer and check if the prev and next block are free, the prev
+         * one from the back tag right before the front tag, or the free
+         * before flag of a layout without footers on busy blocks
+         * if the adjacent blocks are free they are spliced out of the free
+         * list and coalesced with this one in one free block, whose tags
+         * hold the size of the merged payload, the result is pushed on the
+         * free list
+         */
+        void deallocate_bytes (char* _p) {
+
+            if (_p == 0)
+                return;
+
+            int front = busy_block(_p);
+            int total = size(front);
+            S::deallocated(total);
+            const int next = next_block(front);
+
+            if ((front > first) && prev_free(front)) {
+                const int prev = prev_block(front);
+                free_list.remove(*this, prev);
+                total = size(prev) + L::overhead + total;
+                front = prev;
+            }
+
+            if ((next < limit) && is_free(next)) {
+                free_list.remove(*this, next);
+                total = total + L::overhead + size(next);
+            }
+
+            set_free(front, total);
+            free_list.insert(*this, front);
+
+            verify(front);}
+
+        // ------------
+        // resize_bytes
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(1) in time, plus one placement policy insert() and remove()
+         * resize the busy block whose payload starts at p so it holds
+         * bytes, without moving it
+         * to grow, the free block right after it is spliced out of the free
+         * list and absorbed, if what would be left of it can not hold a
+         * free block, all of it is absorbed
+         * to shrink, the tail is split off as a free block, coalesced with
+         * the free block right after it if there is one, if it is too
+         * small for a free block, the block keeps it
+         * return false, and leave the block alone, if the block after it is
+         * busy or too small
+         * throw an invalid_argument exception, if p is invalid
+         */
+        bool resize_bytes (char* _p, std::size_t bytes) {
+
+            const int front = busy_block(_p);
+
+            if (bytes > static_cast<std::size_t>(limit))
+                return false;
+
+            const int  data       = payload(bytes);
+            const int  s          = size(front);
+            const int  next       = next_block(front);
+            const bool after_free = (front > first) && prev_free(front);
+            const bool next_free  = (next < limit) && is_free(next);
+
+            if (data == s)
+                return true;
+
+            if ((data > s) && (!next_free || (s + L::overhead + size(next) < data)))
+                return false;
+
+            int left = s - data - L::overhead;
+
+            if (next_free) {
+                free_list.remove(*this, next);
+                left = left + L::overhead + size(next);
+            }
+
+            if (left >= min_payload) {
+                set_busy(front, data, after_free);
+                set_free(front + L::overhead + data, left);
+                free_list.insert(*this, front + L::overhead + data);
+            }
+            else
+                set_busy(front, data + left + L::overhead, after_free);
+            S::resized(s, size(front));
+
+            verify(front);
+            return true;}};
+
 // ---------
 // Allocator
 // ---------
 
-template <typename T, std::size_t N>
-class Allocator {
-    public:
+/**
+ * a pool of N bytes inside the object, handing out arrays of T
+ * the blocks are laid out by L, boundary_tags by default, compact_tags<N>
+ * for tags as narrow as N allows and no footer on busy blocks
+ * a copy owns a copy of the pool, so copies never compare equal, to
+ * share one pool among containers use an arena and ArenaAllocator
+ */
+template <typename T, std::size_t N, typename P = first_fit, typename C = default_check, typename L = boundary_tags, typename S = default_stats>
+class Allocator : public Heap<Allocator<T, N, P, C, L, S>, alignof(T), P, C, L, S> {
+    public:
+        // --------
+        // typedefs
+        // --------
+
+        typedef T                 value_type;
+
+        typedef std::size_t       size_type;
+        typedef std::ptrdiff_t    difference_type;
+
+        typedef       value_type*       pointer;
+        typedef const value_type* const_pointer;
+
+        typedef       value_type&       reference;
+        typedef const value_type& const_reference;
+
+    public:
+        // -----------
+        // operator ==
+        // -----------
+
+        /**
+         * each Allocator deallocates only what it allocated from its own pool
+         */
+        friend bool operator == (const Allocator& lhs, const Allocator& rhs) {
+            return &lhs == &rhs;}
+
+        // -----------
+        // operator !=
+        // -----------
+
+        friend bool operator != (const Allocator& lhs, const Allocator& rhs) {
+            return !(lhs == rhs);}
+
+
+    private:
+        // ----
+        // data
+        // ----
+
+        typedef Heap<Allocator, alignof(T), P, C, L, S> heap;
+
+        friend heap;
+
+        /**
+         * the pool is aligned for T and for any fundamental type
+         */
+        alignas(std::max_align_t) alignas(T) char a[N];
+
+        static_assert(N <= L::capacity, "N must fit in the tags of L");
+
+        char* data () {
+            return a;}
+
+        const char* data () const {
+            return a;}
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Tests definitions to be able to access to private methods
+         * throught test, in this case to access to the [] operator
+         * on my tests
+         * https://code.google.com/p/googletest/wiki/AdvancedGuide#Private_Class_Members
+         */
+        FRIEND_TEST(TestAllocator2, index);
+        
+        FRIEND_TEST(TestAllocator4, allocate_1);
+        FRIEND_TEST(TestAllocator4, allocate_2);
+        FRIEND_TEST(TestAllocator4, allocate_3);
+        FRIEND_TEST(TestAllocator4, allocate_4);
+        FRIEND_TEST(TestAllocator4, allocate_5);
+        FRIEND_TEST(TestAllocator4, allocate_5);
+        FRIEND_TEST(TestAllocator4, deallocate_1);
+        FRIEND_TEST(TestAllocator4, deallocate_2);
+        FRIEND_TEST(TestAllocator4, deallocate_3);
+        FRIEND_TEST(TestAllocator4, deallocate_4);
+        FRIEND_TEST(TestAllocator4, Allocator_1);
+        FRIEND_TEST(TestAllocator4, Allocator_2);
+        FRIEND_TEST(TestAllocator4, Allocator_3);
+        FRIEND_TEST(TestAllocator5, free_list_1);
+        FRIEND_TEST(TestAllocator5, free_list_2);
+        FRIEND_TEST(TestAllocator5, min_payload_1);
+        FRIEND_TEST(TestAllocator5, min_payload_2);
+        FRIEND_TEST(TestAllocator5, deallocate_1);
+        FRIEND_TEST(TestAllocator6, allocate_1);
+        FRIEND_TEST(TestAllocator6, allocate_2);
+        FRIEND_TEST(TestAllocator6, deallocate_1);
+        FRIEND_TEST(TestAllocator7, next_fit_1);
+        FRIEND_TEST(TestAllocator7, next_fit_2);
+        FRIEND_TEST(TestAllocator7, best_fit_1);
+        FRIEND_TEST(TestAllocator8, check_none_1);
+        FRIEND_TEST(TestAllocator8, check_local_1);
+        FRIEND_TEST(TestAllocator8, check_local_2);
+        FRIEND_TEST(TestAllocator8, check_local_3);
+        FRIEND_TEST(TestAllocator8, check_sampled_1);
+        FRIEND_TEST(TestAllocator8, check_full_1);
+        FRIEND_TEST(TestAllocator10, align_1);
+        FRIEND_TEST(TestAllocator10, align_2);
+        FRIEND_TEST(TestAllocator10, align_3);
+        FRIEND_TEST(TestAllocator10, allocate_aligned_1);
+        FRIEND_TEST(TestAllocator10, allocate_aligned_2);
+        FRIEND_TEST(TestAllocator10, allocate_aligned_4);
+        FRIEND_TEST(TestAllocator10, allocate_aligned_5);
+        FRIEND_TEST(TestAllocator12, compact_2);
+        FRIEND_TEST(TestAllocator12, compact_3);
+        FRIEND_TEST(TestAllocator12, compact_4);
+        FRIEND_TEST(TestAllocator13, expand_1);
+        FRIEND_TEST(TestAllocator13, expand_2);
+        FRIEND_TEST(TestAllocator13, shrink_1);
+        FRIEND_TEST(TestAllocator13, shrink_2);
+        FRIEND_TEST(TestAllocator13, reallocate_1);
+        FRIEND_TEST(TestAllocator13, reallocate_2);
+        FRIEND_TEST(TestAllocator13, reallocate_3);
+
+        template <typename, std::size_t, typename, typename>
+        friend class SharedAllocator;
+
+    public:
+        // ------------
+        // constructors
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * throw a bad_alloc exception, if N is less than the smallest block,
+         * sizeof(T) or min_payload, whichever is bigger, + L::overhead
+         */
+        Allocator () {
+            this->init(N, sizeof(T));}
+
+        // Default copy, destructor, and copy assignment
+        // Allocator  (const Allocator&);
+        // ~Allocator ();
+        // Allocator& operator = (const Allocator&);
+
+        // --------
+        // allocate
+        // --------
+
+        /**
+         * O(1) in space
+         * O(f) in time with first_fit, next_fit and best_fit, f the number
+         * of free blocks
+         * O(1) in time with segregated_fit
+         * return 0 if no free block fits
+         * throw a bad_alloc exception, if n is invalid
+         */
+        pointer allocate (size_type n) {
+
+            const size_type space_needed = (n * sizeof(T)) + L::overhead;
+
+            if (N < space_needed)
+                throw bad_alloc();
+
+            return reinterpret_cast<pointer>(this->allocate_bytes(n * sizeof(T), alignof(T)));}
+
+        // ----------------
+        // allocate_aligned
+        // ----------------
+
+        /**
+         * O(1) in space
+         * same time as allocate()
+         * the payload starts on a multiple of alignment, a power of two,
+         * such as 32 or 64 for vector types or a cache line
+         * return 0 if no free block fits
+         * throw a bad_alloc exception, if n is invalid
+         * throw an invalid_argument exception, if alignment is not a power
+         * of two
+         */
+        pointer allocate_aligned (size_type n, size_type alignment) {
+
+            const size_type space_needed = (n * sizeof(T)) + L::overhead;
+
+            if (N < space_needed)
+                throw bad_alloc();
+
+            return reinterpret_cast<pointer>(this->allocate_bytes(n * sizeof(T), alignment));}
+
+        // ---------
+        // construct
+        // ---------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void construct (pointer p, const_reference v) {
+            new (p) T(v);                               // this is correct and exempt
+            this->verify(-1);}                          // from the prohibition of new
+
+        // ----------
+        // deallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * after deallocation adjacent free blocks must be coalesced
+         * throw an invalid_argument exception, if p is invalid
+         */
+        void deallocate (pointer p, size_type) {
+            this->deallocate_bytes(reinterpret_cast<char*>(p));}
+
+        // ----------
+        // try_expand
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * resize the block at p to hold new_n objects without moving it,
+         * growing into the free block right after it, or shrinking by
+         * splitting off a free tail
+         * return false, and leave the block alone, if it can not
+         * throw an invalid_argument exception, if p is invalid
+         */
+        bool try_expand (pointer p, size_type new_n) {
+            if (new_n > ((N - L::overhead) / sizeof(T)))
+                return false;
+            return this->resize_bytes(reinterpret_cast<char*>(p), new_n * sizeof(T));}
+
+        // ----------
+        // reallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time in place, else the time of allocate() plus a copy of
+         * min(old_n, new_n) objects
+         * resize the block at p, of old_n objects, to new_n objects, in
+         * place with try_expand() if it can, else in a new block the
+         * objects are copied to as bytes, as realloc() does, so T must be
+         * trivially copyable, which is checked at compile time, before p
+         * is deallocated
+         * a 0 p allocates, a 0 new_n deallocates and returns 0
+         * return 0, and leave the block at p alone, if no free block fits
+         * throw a bad_alloc exception, if new_n is invalid
+         * throw an invalid_argument exception, if p is invalid
+         */
+        pointer reallocate (pointer p, size_type old_n, size_type new_n) {
+            if (p == 0)
+                return allocate(new_n);
+            if (new_n == 0) {
+                deallocate(p, old_n);
+                return 0;}
+            static_assert(__has_trivial_copy(T) && __has_trivial_destructor(T), "T must be trivially copyable");
+            if (try_expand(p, new_n))
+                return p;
+            pointer q = allocate(new_n);
+            if (q != 0) {
+                std::memcpy(q, p, std::min(old_n, new_n) * sizeof(T));
+                deallocate(p, old_n);}
+            return q;}
+
+        // -------
+        // destroy
+        // -------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void destroy (pointer p) {
+            p->~T();               // this is correct
+            this->verify(-1);}};
+
+// ----------
+// FixedArena
+// ----------
+
+/**
+ * a pool of N bytes inside the object, aligned to A, for ArenaAllocator
+ * handles to share, not copyable
+ */
+template <std::size_t N, std::size_t A = alignof(std::max_align_t), typename P = first_fit, typename C = default_check, typename L = boundary_tags, typename S = default_stats>
+class FixedArena : public Heap<FixedArena<N, A, P, C, L, S>, A, P, C, L, S> {
+    private:
+        typedef Heap<FixedArena, A, P, C, L, S> heap;
+
+        friend heap;
+
+        alignas(A) char a[N];
+
+        static_assert(N <= L::capacity, "N must fit in the tags of L");
+
+        FRIEND_TEST(TestAllocator11, arena_2);
+
+        char* data () {
+            return a;}
+
+        const char* data () const {
+            return a;}
+
+    public:
+        using heap::allocate_bytes;
+        using heap::deallocate_bytes;
+        using heap::resize_bytes;
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * throw a bad_alloc exception, if N is less than the smallest block
+         */
+        FixedArena () {
+            this->init(N, 1);}
+
+        FixedArena             (const FixedArena&) = delete;
+        FixedArena& operator = (const FixedArena&) = delete;};
+
+// ---------
+// HeapArena
+// ---------
+
+/**
+ * a pool of a size chosen at run time, taken from the free store and
+ * aligned to A, for ArenaAllocator handles to share, not copyable
+ */
+template <std::size_t A = alignof(std::max_align_t), typename P = first_fit, typename C = default_check, typename L = boundary_tags, typename S = default_stats>
+class HeapArena : public Heap<HeapArena<A, P, C, L, S>, A, P, C, L, S> {
+    private:
+        typedef Heap<HeapArena, A, P, C, L, S> heap;
+
+        friend heap;
+
+        std::unique_ptr<char[]> buffer;
+        char*                   a;
+
+        FRIEND_TEST(TestAllocator11, arena_3);
+
+        char* data () {
+            return a;}
+
+        const char* data () const {
+            return a;}
+
+    public:
+        using heap::allocate_bytes;
+        using heap::deallocate_bytes;
+        using heap::resize_bytes;
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * throw a bad_alloc exception, if size is less than the smallest block
+         */
+        explicit HeapArena (std::size_t size) :
+                buffer (new char[size + A]),
+                a      (reinterpret_cast<char*>((reinterpret_cast<std::size_t>(buffer.get()) + A - 1) & ~(A - 1))) {
+            this->init(size, 1);}
+
+        HeapArena             (const HeapArena&) = delete;
+        HeapArena& operator = (const HeapArena&) = delete;};
+
+// -----------
+// MappedArena
+// -----------
+
+/**
+ * a pool of a size chosen at run time, mapped anonymously from the
+ * operating system, page aligned, so A may be up to the page size, for
+ * ArenaAllocator handles to share, not copyable
+ */
+template <std::size_t A = alignof(std::max_align_t), typename P = first_fit, typename C = default_check, typename L = boundary_tags, typename S = default_stats>
+class MappedArena : public Heap<MappedArena<A, P, C, L, S>, A, P, C, L, S> {
+    private:
+        typedef Heap<MappedArena, A, P, C, L, S> heap;
+
+        friend heap;
+
+        char*       a;
+        std::size_t length;
+
+        FRIEND_TEST(TestAllocator11, arena_4);
+
+        char* data () {
+            return a;}
+
+        const char* data () const {
+            return a;}
+
+    public:
+        using heap::allocate_bytes;
+        using heap::deallocate_bytes;
+        using heap::resize_bytes;
+
+        /**
+         * O(1) in space
+         * O(1) in time, the pages are only touched when they are used
+         * throw a bad_alloc exception, if the mapping fails, or if size is
+         * less than the smallest block
+         */
+        explicit MappedArena (std::size_t size) :
+                a      (0),
+                length (size) {
+            void* p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw bad_alloc();
+            a = static_cast<char*>(p);
+            try {
+                this->init(size, 1);}
+            catch (...) {
+                munmap(a, size);
+                throw;}}
+
+        MappedArena             (const MappedArena&) = delete;
+        MappedArena& operator = (const MappedArena&) = delete;
+
+        ~MappedArena () {
+            munmap(a, length);}};
+
+// --------------
+// ArenaAllocator
+// --------------
+
+/**
+ * a handle to an arena, FixedArena, HeapArena or MappedArena, copies and
+ * rebound copies share the arena, so node containers of different types
+ * can share one pool and copying the allocator costs a pointer
+ * allocate() throws bad_alloc when the arena is full, as containers
+ * expect, instead of returning 0
+ */
+template <typename T, typename R>
+class ArenaAllocator {
+    public:
+        // --------
+        // typedefs
+        // --------
+
+        typedef T                 value_type;
+
+        typedef std::size_t       size_type;
+        typedef std::ptrdiff_t    difference_type;
+
+        typedef       value_type*       pointer;
+        typedef const value_type* const_pointer;
+
+        typedef       value_type&       reference;
+        typedef const value_type& const_reference;
+
+        template <typename U>
+        struct rebind {
+            typedef ArenaAllocator<U, R> other;};
+
+    public:
+        // -----------
+        // operator ==
+        // -----------
+
+        /**
+         * equal when they share the arena, so one deallocates what the
+         * other allocated
+         */
+        template <typename U>
+        friend bool operator == (const ArenaAllocator& lhs, const ArenaAllocator<U, R>& rhs) {
+            return &lhs.resource() == &rhs.resource();}
+
+        // -----------
+        // operator !=
+        // -----------
+
+        template <typename U>
+        friend bool operator != (const ArenaAllocator& lhs, const ArenaAllocator<U, R>& rhs) {
+            return !(lhs == rhs);}
+
+    private:
+        // ----
+        // data
+        // ----
+
+        R* arena;
+
+        template <typename, typename>
+        friend class ArenaAllocator;
+
+    public:
+        // ------------
+        // constructors
+        // ------------
+
+        explicit ArenaAllocator (R& r) :
+                arena (&r)
+            {}
+
+        template <typename U>
+        ArenaAllocator (const ArenaAllocator<U, R>& that) :
+                arena (that.arena)
+            {}
+
+        // Default copy, destructor, and copy assignment
+        // ArenaAllocator  (const ArenaAllocator&);
+        // ~ArenaAllocator ();
+        // ArenaAllocator& operator = (const ArenaAllocator&);
+
+        // --------
+        // resource
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * the arena this handle allocates from
+         */
+        R& resource () const {
+            return *arena;}
+
+        // --------
+        // allocate
+        // --------
+
+        /**
+         * O(1) in space
+         * same time as the placement policy of the arena
+         * throw a bad_alloc exception, if the arena has no block for n
+         * objects left
+         */
+        pointer allocate (size_type n) {
+            if (n > (std::numeric_limits<size_type>::max() / sizeof(T)))
+                throw bad_alloc();
+            char* p = arena->allocate_bytes(n * sizeof(T), alignof(T));
+            if (p == 0)
+                throw bad_alloc();
+            return reinterpret_cast<pointer>(p);}
+
+        // ---------
+        // construct
+        // ---------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        template <typename U, typename... Args>
+        void construct (U* p, Args&&... args) {
+            new (p) U(std::forward<Args>(args)...);}    // this is correct and exempt
+                                                        // from the prohibition of new
+        // ----------
+        // deallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * throw an invalid_argument exception, if p is invalid
+         */
+        void deallocate (pointer p, size_type) {
+            arena->deallocate_bytes(reinterpret_cast<char*>(p));}
+
+        // ----------
+        // try_expand
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * resize the block at p to hold new_n objects without moving it
+         * return false, and leave the block alone, if it can not
+         * throw an invalid_argument exception, if p is invalid
+         */
+        bool try_expand (pointer p, size_type new_n) {
+            if (new_n > (std::numeric_limits<size_type>::max() / sizeof(T)))
+                return false;
+            return arena->resize_bytes(reinterpret_cast<char*>(p), new_n * sizeof(T));}
+
+        // ----------
+        // reallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time in place, else the time of allocate() plus a copy of
+         * min(old_n, new_n) objects, copied as bytes, so T must be
+         * trivially copyable, which is checked at compile time
+         * a 0 p allocates, a 0 new_n deallocates and returns 0
+         * throw a bad_alloc exception, and leave the block at p alone, if
+         * the arena has no block for new_n objects left
+         */
+        pointer reallocate (pointer p, size_type old_n, size_type new_n) {
+            if (p == 0)
+                return allocate(new_n);
+            if (new_n == 0) {
+                deallocate(p, old_n);
+                return 0;}
+            static_assert(__has_trivial_copy(T) && __has_trivial_destructor(T), "T must be trivially copyable");
+            if (try_expand(p, new_n))
+                return p;
+            pointer q = allocate(new_n);
+            std::memcpy(q, p, std::min(old_n, new_n) * sizeof(T));
+            deallocate(p, old_n);
+            return q;}
+
+        // -------
+        // destroy
+        // -------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        template <typename U>
+        void destroy (U* p) {
+            p->~U();}};            // this is correct
+
+// ---------------
+// SharedAllocator
+// ---------------
+
+/**
+ * one pool shared by many threads
+ * the boundary tag heap is an Allocator of bytes guarded by a mutex, each
+ * thread owns a cache of blocks it allocated and freed, one list per
+ * size, taken from and given back to the heap in batches under the lock
+ * a block freed by a thread other than the one that allocated it is
+ * pushed on the remote list of the owner's cache with a CAS, lock free,
+ * many threads push but only the owner takes the whole list at once
+ * the remote list of a cache no thread owns is the orphaned marker, a
+ * block freed to it goes straight back to the heap under the lock
+ * every block starts with a header naming its cache and size class
+ * threads beyond max_threads, and requests of more than cache_classes
+ * objects, go straight to the heap under the lock
+ */
+template <typename T, std::size_t N, typename P = first_fit, typename C = default_check>
+class SharedAllocator {
+    public:
+        // --------
+        // typedefs
+        // --------
+
+        typedef T                 value_type;
+
+        typedef std::size_t       size_type;
+        typedef std::ptrdiff_t    difference_type;
+
+        typedef       value_type*       pointer;
+        typedef const value_type* const_pointer;
+
+        typedef       value_type&       reference;
+        typedef const value_type& const_reference;
+
+    public:
+        // -----------
+        // operator ==
+        // -----------
+
+        friend bool operator == (const SharedAllocator& lhs, const SharedAllocator& rhs) {
+            return &lhs == &rhs;}
+
+        // -----------
+        // operator !=
+        // -----------
+
+        friend bool operator != (const SharedAllocator& lhs, const SharedAllocator& rhs) {
+            return !(lhs == rhs);}
+
+    private:
+        // ----
+        // data
+        // ----
+
+        /**
+         * header of every block, owner is the index of the cache of the
+         * thread that allocated it, -1 if it came straight from the heap,
+         * size is the number of objects, next links the block on a cache
+         */
+        struct block {
+            block* next;
+            int    owner;
+            int    size;};
+
+        static const int max_threads   = 16;
+        static const int cache_classes = 8;
+        static const int batch         = 8;
+        static const int cache_limit   = 4 * batch;
+
+        /**
+         * remote is the orphaned marker while owner is no thread
+         */
+        struct cache {
+            std::atomic<std::thread::id> owner;
+            std::atomic<block*>          remote;
+            block*                       bins[cache_classes];
+            int                          counts[cache_classes];};
+
+        /**
+         * unit the heap hands out, aligned for the header and for T, the
+         * objects start prefix bytes after the header
+         */
+        static const std::size_t unit_align = alignof(T) < alignof(block) ? alignof(block) : alignof(T);
+
+        struct alignas(unit_align) unit {};
+
+        static const std::size_t prefix = ((sizeof(block) + alignof(unit) - 1) / alignof(unit)) * alignof(unit);
+
+        Allocator<unit, N, P, C> heap;
+        std::mutex               lock;
+        cache                    caches[max_threads];
+        block                    orphan;
+
+        FRIEND_TEST(TestAllocator9, cache_1);
+        FRIEND_TEST(TestAllocator9, cache_2);
+        FRIEND_TEST(TestAllocator9, remote_1);
+        FRIEND_TEST(TestAllocator9, remote_2);
+        FRIEND_TEST(TestAllocator9, stress_1);
+
+        // -----
+        // valid
+        // -----
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * the heap is valid, cached blocks are busy blocks of the heap
+         */
+        bool valid () {
+            std::lock_guard<std::mutex> guard(lock);
+            return heap.valid();}
+
+        // -----
+        // local
+        // -----
+
+        /**
+         * O(1) in space
+         * O(max_threads) in time, O(1) when the calling thread used this
+         * allocator last
+         * the cache of the calling thread, claiming a free one the first
+         * time, 0 if all of them are taken
+         */
+        int local () {
+            static thread_local const SharedAllocator* last_allocator = 0;
+            static thread_local int                    last_cache     = -1;
+
+            const std::thread::id me = std::this_thread::get_id();
+            if ((last_allocator == this) && (caches[last_cache].owner.load(std::memory_order_relaxed) == me))
+                return last_cache;
+
+            int c = -1;
+            for (int i = 0; (c == -1) && (i != max_threads); ++i)
+                if (caches[i].owner.load(std::memory_order_acquire) == me)
+                    c = i;
+            for (int i = 0; (c == -1) && (i != max_threads); ++i) {
+                std::thread::id none;
+                if (caches[i].owner.compare_exchange_strong(none, me, std::memory_order_acquire)) {
+                    caches[i].remote.store(0, std::memory_order_release);
+                    c = i;}}
+
+            if (c != -1) {
+                last_allocator = this;
+                last_cache     = c;}
+            return c;}
+
+        // -----
+        // cache
+        // -----
+
+        /**
+         * the remote list of a cache no thread owns, never a real block
+         */
+        block* orphaned () {
+            return &orphan;}
+
+        static pointer data (block* b) {
+            return reinterpret_cast<pointer>(reinterpret_cast<char*>(b) + prefix);}
+
+        static block* header (pointer p) {
+            return reinterpret_cast<block*>(reinterpret_cast<char*>(p) - prefix);}
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * a block of n objects from the heap, the lock must be held
+         * throw a bad_alloc exception, if n is invalid
+         */
+        block* take (size_type n) {
+            block* b = reinterpret_cast<block*>(heap.allocate((prefix + (n * sizeof(T)) + sizeof(unit) - 1) / sizeof(unit)));
+            if (b != 0)
+                b->size = n;
+            return b;}
+
+        /**
+         * O(1) in space
+         * O(r) in time, r the number of remote frees
+         * move the blocks other threads freed onto the lists of cache c,
+         * only its owner may call it
+         */
+        void drain (int c) {
+            block* b = caches[c].remote.exchange(0, std::memory_order_acquire);
+            while (b != 0) {
+                block* next = b->next;
+                b->next = caches[c].bins[b->size - 1];
+                caches[c].bins[b->size - 1] = b;
+                ++caches[c].counts[b->size - 1];
+                b = next;}}
+
+        /**
+         * O(1) in space
+         * O(k) heap operations in time
+         * give k blocks of class s of cache c back to the heap, all of
+         * them if k is -1, or all the blocks of cache c if s is not given,
+         * the lock must be held
+         */
+        void release (int c, int s, int k) {
+            while ((caches[c].bins[s] != 0) && (k-- != 0)) {
+                block* b = caches[c].bins[s];
+                caches[c].bins[s] = b->next;
+                --caches[c].counts[s];
+                heap.deallocate(reinterpret_cast<unit*>(b), 0);}}
+
+        void release (int c) {
+            for (int s = 0; s != cache_classes; ++s)
+                release(c, s, -1);}
+
+    public:
+        // ------------
+        // constructors
+        // ------------
+
+        /**
+         * O(max_threads) in space
+         * O(max_threads) in time
+         * throw a bad_alloc exception, if N is less than the smallest block
+         */
+        SharedAllocator () {
+            for (int c = 0; c != max_threads; ++c) {
+                caches[c].owner.store(std::thread::id());
+                caches[c].remote.store(orphaned());
+                for (int s = 0; s != cache_classes; ++s) {
+                    caches[c].bins[s]   = 0;
+                    caches[c].counts[s] = 0;}}}
+
+        SharedAllocator             (const SharedAllocator&) = delete;
+        SharedAllocator& operator = (const SharedAllocator&) = delete;
+
         // --------
-        // typedefs
+        // allocate
         // --------
 
-        typedef T                 value_type;
+        /**
+         * O(1) in space
+         * O(1) in time from the cache, a batch of heap allocations under
+         * the lock when it is empty
+         * return 0 if the pool has no block for n objects left
+         * throw a bad_alloc exception, if n is invalid
+         */
+        pointer allocate (size_type n) {
 
-        typedef std::size_t       size_type;
-        typedef std::ptrdiff_t    difference_type;
+            if (n == 0)
+                return 0;
 
-        typedef       value_type*       pointer;
-        typedef const value_type* const_pointer;
+            const int c = (n <= static_cast<size_type>(cache_classes)) ? local() : -1;
 
-        typedef       value_type&       reference;
-        typedef const value_type& const_reference;
+            if (c == -1) {
+                std::lock_guard<std::mutex> guard(lock);
+                block* b = take(n);
+                if (b == 0)
+                    return 0;
+                b->owner = -1;
+                return data(b);}
 
-    public:
-        // -----------
-        // operator ==
-        // -----------
+            const int s = n - 1;
+            cache& k = caches[c];
 
-        friend bool operator == (const Allocator&, const Allocator&) {
-            return true;}                                              // this is correct
+            if (k.bins[s] == 0)
+                drain(c);
 
-        // -----------
-        // operator !=
-        // -----------
+            if (k.bins[s] == 0) {
+                std::lock_guard<std::mutex> guard(lock);
+                for (int i = 0; i != batch; ++i) {
+                    block* b = take(n);
+                    if (b == 0)
+                        break;
+                    b->next = k.bins[s];
+                    k.bins[s] = b;
+                    ++k.counts[s];}
+                if (k.bins[s] == 0) {
+                    release(c);
+                    block* b = take(n);
+                    if (b == 0)
+                        return 0;
+                    b->next = 0;
+                    k.bins[s] = b;
+                    ++k.counts[s];}}
 
-        friend bool operator != (const Allocator& lhs, const Allocator& rhs) {
-            return !(lhs == rhs);}
+            block* b = k.bins[s];
+            k.bins[s] = b->next;
+            --k.counts[s];
+            b->owner = c;
+            return data(b);}
+
+        // ---------
+        // construct
+        // ---------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void construct (pointer p, const_reference v) {
+            new (p) T(v);}                              // this is correct and exempt
+                                                        // from the prohibition of new
+        // ----------
+        // deallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time to the cache or the remote list of the owner, a
+         * batch of heap deallocations under the lock when the cache is full
+         * blocks freed by their owner go back on its cache, blocks freed
+         * by another thread are pushed on the remote list of their owner,
+         * or go back to the heap under the lock, if it has no owner
+         */
+        void deallocate (pointer p, size_type) {
+
+            if (p == 0)
+                return;
+
+            block* b = header(p);
+
+            if (b->owner == -1) {
+                std::lock_guard<std::mutex> guard(lock);
+                heap.deallocate(reinterpret_cast<unit*>(b), 0);
+                return;}
+
+            const int s = b->size - 1;
+            cache& k = caches[b->owner];
+
+            if (k.owner.load(std::memory_order_relaxed) != std::this_thread::get_id()) {
+                b->next = k.remote.load(std::memory_order_acquire);
+                while (b->next != orphaned())
+                    if (k.remote.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_acquire))
+                        return;
+                std::lock_guard<std::mutex> guard(lock);
+                heap.deallocate(reinterpret_cast<unit*>(b), 0);
+                return;}
+
+            b->next = k.bins[s];
+            k.bins[s] = b;
+            if (++k.counts[s] > cache_limit) {
+                std::lock_guard<std::mutex> guard(lock);
+                release(b->owner, s, cache_limit / 2);}}
+
+        // -------
+        // destroy
+        // -------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void destroy (pointer p) {
+            p->~T();}              // this is correct
 
+        // -----
+        // flush
+        // -----
+
+        /**
+         * O(1) in space
+         * O(c) heap operations in time, c the number of cached blocks
+         * give every block in the cache of the calling thread, and on its
+         * remote list, back to the heap and let another thread claim the
+         * cache, call it before a thread exits, blocks it still owns are
+         * freed remotely, straight to the heap
+         */
+        void flush () {
+            const std::thread::id me = std::this_thread::get_id();
+            for (int c = 0; c != max_threads; ++c) {
+                if (caches[c].owner.load(std::memory_order_acquire) != me)
+                    continue;
+                std::lock_guard<std::mutex> guard(lock);
+                release(c);
+                block* b = caches[c].remote.exchange(orphaned(), std::memory_order_acq_rel);
+                while (b != 0) {
+                    block* next = b->next;
+                    heap.deallocate(reinterpret_cast<unit*>(b), 0);
+                    b = next;}
+                caches[c].owner.store(std::thread::id(), std::memory_order_release);}}};
+
+// ---------
+// SlabArena
+// ---------
+
+/**
+ * small blocks from slabs, carved out of an arena, FixedArena, HeapArena
+ * or MappedArena, for SlabAllocator handles to share, not copyable
+ * a slab is a block of S bytes, a power of two, taken from the arena
+ * on a multiple of S, so the slab of a slot is found by masking its
+ * address, it starts with a header and a bitmap of its free slots,
+ * followed by slots of one size class, a multiple of grain bytes, with
+ * no header of their own, so a 4 byte T takes 4 bytes
+ * a request of up to classes * grain bytes, rounded up to its alignment,
+ * at most that of max_align_t, takes the first free slot of the first
+ * slab of its class with one, a full slab leaves the list of its class,
+ * the first one to empty is kept as the spare of its class, so one
+ * object allocated and freed over and over does not carve a slab every
+ * time, any other empty one goes back to the arena, where
+ * deallocate_bytes() coalesces it as any block
+ * bigger or more aligned requests go straight to the arena
+ */
+template <typename R, std::size_t S = 1024>
+class SlabArena {
+    public:
+        /**
+         * slot sizes are multiples of grain, slots start on a multiple of
+         * max_align, so a slot is aligned for any size a multiple of the
+         * alignment
+         */
+        static const std::size_t grain     = 4;
+        static const std::size_t max_align = alignof(std::max_align_t);
 
     private:
         // ----
         // data
         // ----
 
-        char a[N];
+        static const int words = ((S / grain) + 63) / 64;
+
+        /**
+         * header of every slab, next and prev link it on the list of slabs
+         * of its class with free slots, size is the size of its slots, a
+         * set bit in free_bits is a free slot
+         */
+        struct slab {
+            slab*         next;
+            slab*         prev;
+            int           size;
+            int           slots;
+            int           used;
+            std::uint64_t free_bits[words];};
+
+        /**
+         * a slab is a block of the arena whose payload is length bytes, so
+         * the block, tags and all, is S bytes long, and slabs carved one
+         * after the other are adjacent, the slots start offset bytes into it
+         */
+        static const std::size_t length  = S - R::layout::overhead;
+        static const std::size_t offset  = ((sizeof(slab) + max_align - 1) / max_align) * max_align;
+
+    public:
+        /**
+         * number of size classes, every slab holds at least 8 slots, and
+         * slots are at most 32 * grain bytes
+         */
+        static const int classes = ((length - offset) / 8) / grain < 32 ? ((length - offset) / 8) / grain : 32;
+
+    private:
+        static_assert((S & (S - 1)) == 0, "S must be a power of two");
+        static_assert(S > R::layout::overhead + sizeof(slab), "S must hold a slab header");
+        static_assert(classes >= 1, "S must hold at least 8 slots of grain bytes");
+
+        R*    arena;
+        slab* partial[classes];
+        slab* spare[classes];
+
+        FRIEND_TEST(TestAllocator14, slab_1);
+        FRIEND_TEST(TestAllocator14, slab_2);
+        FRIEND_TEST(TestAllocator14, slab_3);
+        FRIEND_TEST(TestAllocator14, slab_4);
+        FRIEND_TEST(TestAllocator14, slab_5);
+        FRIEND_TEST(TestAllocator14, slab_6);
 
         // -----
         // valid
@@ -71,132 +2329,339 @@ class Allocator {
 
         /**
          * O(1) in space
-         * O(n) in time
-         * Check that the front sentinel is equal to the back sentinel por block
+         * O(s) in time, s the number of slabs with free slots
+         * every slab with free slots has as many busy slots as it counts,
+         * is of the class of its list, and is linked both ways, every
+         * spare slab is of its class and has all its slots free
          */
         bool valid () const {
+            for (int c = 0; c != classes; ++c) {
+                const slab* prev = 0;
+                for (const slab* s = partial[c]; s != 0; s = s->next) {
+                    int busy = s->slots;
+                    for (int w = 0; w != words; ++w)
+                        busy -= __builtin_popcountll(s->free_bits[w]);
+                    if ((s->prev != prev) || (s->size != static_cast<int>((c + 1) * grain)) ||
+                        (busy != s->used) || (busy == s->slots) || (busy == 0))
+                        return false;
+                    prev = s;}
+                const slab* s = spare[c];
+                if (s != 0) {
+                    int free = 0;
+                    for (int w = 0; w != words; ++w)
+                        free += __builtin_popcountll(s->free_bits[w]);
+                    if ((s->size != static_cast<int>((c + 1) * grain)) || (s->used != 0) || (free != s->slots))
+                        return false;}}
+            return true;}
+
+        // ----
+        // slab
+        // ----
 
-            if ((*this)[0] == 0) return false;
+        /**
+         * O(1) in space
+         * O(1) in time
+         * size class of a request, its bytes rounded up to its alignment,
+         * -1 if it goes to the arena
+         */
+        static int size_class (std::size_t bytes, std::size_t alignment) {
+            if ((bytes == 0) || (alignment == 0) || ((alignment & (alignment - 1)) != 0) || (alignment > max_align))
+                return -1;
+            const std::size_t unit = alignment < grain ? grain : alignment;
+            const std::size_t size = ((bytes + unit - 1) / unit) * unit;
+            if (size > classes * grain)
+                return -1;
+            return (size / grain) - 1;}
 
-            int positive_sentinel = 0;
-            int i = 0;
+        static slab* slab_of (const char* p) {
+            return reinterpret_cast<slab*>(reinterpret_cast<std::size_t>(p) & ~(S - 1));}
 
-            while (i < N) {
-                positive_sentinel = (*this)[i] < 0 ? (-1 * (*this)[i]) : (*this)[i];
-                /*cout << "valid_front: " << (*this)[i] << "\n";
-                cout << "valid_back: " << (*this)[i + sizeof(int) + positive_sentinel] << "\n";
-                cout << "valid_last: " << (*this)[N - sizeof(int)] << "\n";*/
-                if ((*this)[i] != (*this)[i + sizeof(int) + positive_sentinel])
-                    return false;
-                i = i + (2 * sizeof(int)) + positive_sentinel;
-            }
-            return true;}
+        static char* slot (slab* s, int i) {
+            return reinterpret_cast<char*>(s) + offset + (i * s->size);}
+
+        void link (slab* s) {
+            slab*& head = partial[(s->size / grain) - 1];
+            s->next = head;
+            s->prev = 0;
+            if (head != 0)
+                head->prev = s;
+            head = s;}
+
+        void unlink (slab* s) {
+            if (s->prev != 0)
+                s->prev->next = s->next;
+            else
+                partial[(s->size / grain) - 1] = s->next;
+            if (s->next != 0)
+                s->next->prev = s->prev;}
 
         /**
          * O(1) in space
-         * O(1) in time
-         * Tests definitions to be able to access to private methods
-         * throught test, in this case to access to the [] operator
-         * on my tests
-         * https://code.google.com/p/googletest/wiki/AdvancedGuide#Private_Class_Members
+         * O(classes) deallocate_bytes() of the arena in time
+         * give the spare slabs back to the arena, false if there were none
          */
-        FRIEND_TEST(TestAllocator2, index);
-        
-        FRIEND_TEST(TestAllocator4, allocate_1);
-        FRIEND_TEST(TestAllocator4, allocate_2);
-        FRIEND_TEST(TestAllocator4, allocate_3);
-        FRIEND_TEST(TestAllocator4, allocate_4);
-        FRIEND_TEST(TestAllocator4, allocate_5);
-        FRIEND_TEST(TestAllocator4, allocate_5);
-        FRIEND_TEST(TestAllocator4, deallocate_1);
-        FRIEND_TEST(TestAllocator4, deallocate_2);
-        FRIEND_TEST(TestAllocator4, deallocate_3);
-        FRIEND_TEST(TestAllocator4, deallocate_4);
-        FRIEND_TEST(TestAllocator4, Allocator_1);
-        FRIEND_TEST(TestAllocator4, Allocator_2);
-        FRIEND_TEST(TestAllocator4, Allocator_3);
+        bool release () {
+            bool any = false;
+            for (int c = 0; c != classes; ++c)
+                if (spare[c] != 0) {
+                    arena->deallocate_bytes(reinterpret_cast<char*>(spare[c]));
+                    spare[c] = 0;
+                    any = true;}
+            return any;}
 
-        int& operator [] (int i) {
-            return *reinterpret_cast<int*>(&a[i]);}
+        /**
+         * O(1) in space
+         * O(1) in time for the spare, else the time of allocate_bytes() of
+         * the arena
+         * a slab of class c with all its slots free, the spare if there is
+         * one, on the list, 0 if the arena has no block of length bytes on
+         * a multiple of S left, even once the spares of the other classes
+         * are given back to it
+         */
+        slab* carve (int c) {
+            if (spare[c] != 0) {
+                slab* s = spare[c];
+                spare[c] = 0;
+                link(s);
+                return s;}
+            slab* s = reinterpret_cast<slab*>(arena->allocate_bytes(length, S));
+            if (s == 0) {
+                if (!release())
+                    return 0;
+                s = reinterpret_cast<slab*>(arena->allocate_bytes(length, S));
+                if (s == 0)
+                    return 0;}
+            s->size  = (c + 1) * grain;
+            s->slots = std::min<std::size_t>((length - offset) / s->size, 64 * words);
+            s->used  = 0;
+            for (int w = 0; w != words; ++w)
+                s->free_bits[w] = 0;
+            for (int i = 0; i != s->slots; ++i)
+                s->free_bits[i / 64] |= std::uint64_t(1) << (i % 64);
+            link(s);
+            return s;}
 
     public:
         // ------------
         // constructors
         // ------------
 
+        explicit SlabArena (R& r) :
+                arena (&r) {
+            for (int c = 0; c != classes; ++c) {
+                partial[c] = 0;
+                spare[c]   = 0;}}
+
+        SlabArena             (const SlabArena&) = delete;
+        SlabArena& operator = (const SlabArena&) = delete;
+
+        /**
+         * O(1) in space
+         * O(classes) deallocate_bytes() of the arena in time
+         * the spare slabs go back to the arena, slabs with busy slots stay
+         * busy blocks of it
+         */
+        ~SlabArena () {
+            release();}
+
+        // --------
+        // resource
+        // --------
+
         /**
          * O(1) in space
          * O(1) in time
-         * throw a bad_alloc exception, if N is less than sizeof(T) + (2 * sizeof(int))
+         * the arena the slabs are carved out of
          */
-        Allocator () {
+        R& resource () const {
+            return *arena;}
 
-            if (N < (sizeof(T) + (2 * sizeof(int))))
-                throw bad_alloc();
-            (*this)[0] = N - (2 * sizeof(int));
-            (*this)[N - sizeof(int)] = N - (2 * sizeof(int)); 
+        // --------------
+        // allocate_bytes
+        // --------------
 
-            assert(valid());}
+        /**
+         * O(1) in space
+         * O(1) in time for a slot, a slab from the arena when those of its
+         * class are all full and it has no spare, the time of
+         * allocate_bytes() of the arena for a bigger request
+         * return 0 if no slot and no free block fits
+         * throw an invalid_argument exception, if alignment is not a power
+         * of two
+         */
+        char* allocate_bytes (std::size_t bytes, std::size_t alignment) {
+            const int c = size_class(bytes, alignment);
+            if (c == -1)
+                return arena->allocate_bytes(bytes, alignment);
 
-        // Default copy, destructor, and copy assignment
-        // Allocator  (const Allocator&);
-        // ~Allocator ();
-        // Allocator& operator = (const Allocator&);
+            slab* s = (partial[c] != 0) ? partial[c] : carve(c);
+            if (s == 0)
+                return 0;
+
+            int w = 0;
+            while (s->free_bits[w] == 0)
+                ++w;
+            const int b = __builtin_ctzll(s->free_bits[w]);
+            s->free_bits[w] &= ~(std::uint64_t(1) << b);
+            if (++s->used == s->slots)
+                unlink(s);
+            return slot(s, (w * 64) + b);}
+
+        // ----------------
+        // deallocate_bytes
+        // ----------------
+
+        /**
+         * O(1) in space
+         * O(1) in time for a slot, the time of deallocate_bytes() of the
+         * arena for a bigger request, or when the slab is left empty and
+         * its class already has a spare
+         * bytes and alignment must be those p was allocated with
+         * throw an invalid_argument exception, if p is invalid, or its
+         * slot is already free
+         */
+        void deallocate_bytes (char* p, std::size_t bytes, std::size_t alignment) {
+            const int c = size_class(bytes, alignment);
+            if (c == -1) {
+                arena->deallocate_bytes(p);
+                return;}
+
+            if (p == 0)
+                return;
+
+            slab* s = slab_of(p);
+            if (!arena->contains(reinterpret_cast<char*>(s)) || !arena->contains(p) ||
+                (s->size != static_cast<int>((c + 1) * grain)))
+                throw invalid_argument("Invalid pointer - Pointer is not a busy slot");
+
+            const std::ptrdiff_t d = p - slot(s, 0);
+            const std::ptrdiff_t i = d / s->size;
+            if ((d < 0) || ((d % s->size) != 0) || (i >= s->slots) || ((s->free_bits[i / 64] >> (i % 64)) & 1))
+                throw invalid_argument("Invalid pointer - Pointer is not a busy slot");
+
+            if (s->used == s->slots)
+                link(s);
+            s->free_bits[i / 64] |= std::uint64_t(1) << (i % 64);
+            if (--s->used == 0) {
+                unlink(s);
+                if (spare[c] == 0)
+                    spare[c] = s;
+                else
+                    arena->deallocate_bytes(reinterpret_cast<char*>(s));}}};
+
+// -------------
+// SlabAllocator
+// -------------
 
+/**
+ * a handle to a SlabArena, copies and rebound copies share it, so the
+ * nodes of list, map and set, one small object each, come from its
+ * slabs, with no tags of their own
+ * allocate() throws bad_alloc when the arena is full, as containers
+ * expect, instead of returning 0
+ */
+template <typename T, typename R>
+class SlabAllocator {
+    public:
         // --------
-        // allocate
+        // typedefs
         // --------
 
+        typedef T                 value_type;
+
+        typedef std::size_t       size_type;
+        typedef std::ptrdiff_t    difference_type;
+
+        typedef       value_type*       pointer;
+        typedef const value_type* const_pointer;
+
+        typedef       value_type&       reference;
+        typedef const value_type& const_reference;
+
+        template <typename U>
+        struct rebind {
+            typedef SlabAllocator<U, R> other;};
+
+    public:
+        // -----------
+        // operator ==
+        // -----------
+
         /**
-         * O(1) in space
-         * O(n) in time
-         * after allocation there must be enough space left for a valid block
-         * the smallest allowable block is sizeof(T) + (2 * sizeof(int))
-         * choose the first block that fits
-         * throw a bad_alloc exception, if n is invalid
+         * equal when they share the slab arena, so one deallocates what
+         * the other allocated
          */
-        pointer allocate (size_type n) {
+        template <typename U>
+        friend bool operator == (const SlabAllocator& lhs, const SlabAllocator<U, R>& rhs) {
+            return &lhs.resource() == &rhs.resource();}
 
-            const int space_needed = (n * sizeof(T)) + (2 * (sizeof(int)));
+        // -----------
+        // operator !=
+        // -----------
 
-            if (N < space_needed)
-                throw bad_alloc();
-            
-            if (n ==  0)
-                return 0;
+        template <typename U>
+        friend bool operator != (const SlabAllocator& lhs, const SlabAllocator<U, R>& rhs) {
+            return !(lhs == rhs);}
 
-            const int data_space_needed = n * sizeof(T);
-            int i = 0;
+    private:
+        // ----
+        // data
+        // ----
 
-            while (i < N) { 
+        R* slabs;
 
-                int& front_sentinel = (*this)[i];
-                int positive_sentinel = front_sentinel < 0 ? (-1 * front_sentinel) : front_sentinel;
-                int& back_sentinel = (*this)[i + positive_sentinel + sizeof(int)];
-                
-                if (front_sentinel != back_sentinel)
-                    throw bad_alloc();
+        template <typename, typename>
+        friend class SlabAllocator;
 
-                if (front_sentinel == data_space_needed) {
-                    front_sentinel = back_sentinel = (-1 * data_space_needed);
-                    break;
-                }
+    public:
+        // ------------
+        // constructors
+        // ------------
 
-                if (front_sentinel > space_needed) {
-                    front_sentinel = (-1 * data_space_needed);
-                    back_sentinel = back_sentinel - space_needed;
-                    (*this)[i + data_space_needed + sizeof(int)] = front_sentinel;
-                    (*this)[i + space_needed] = back_sentinel;
-                    break;
-                }
-                i = i + positive_sentinel + 2 * sizeof(int); 
-            }
+        explicit SlabAllocator (R& r) :
+                slabs (&r)
+            {}
 
-            if (i >= N)
-                return 0;
+        template <typename U>
+        SlabAllocator (const SlabAllocator<U, R>& that) :
+                slabs (that.slabs)
+            {}
+
+        // Default copy, destructor, and copy assignment
+        // SlabAllocator  (const SlabAllocator&);
+        // ~SlabAllocator ();
+        // SlabAllocator& operator = (const SlabAllocator&);
+
+        // --------
+        // resource
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * the slab arena this handle allocates from
+         */
+        R& resource () const {
+            return *slabs;}
+
+        // --------
+        // allocate
+        // --------
 
-            return reinterpret_cast<pointer>(&a[i + sizeof(int)]);}
-            
+        /**
+         * O(1) in space
+         * O(1) in time for a small object, the time of the placement
+         * policy of the arena for more
+         * throw a bad_alloc exception, if the arena has no slot and no
+         * block for n objects left
+         */
+        pointer allocate (size_type n) {
+            if (n > (std::numeric_limits<size_type>::max() / sizeof(T)))
+                throw bad_alloc();
+            char* p = slabs->allocate_bytes(n * sizeof(T), alignof(T));
+            if (p == 0)
+                throw bad_alloc();
+            return reinterpret_cast<pointer>(p);}
 
         // ---------
         // construct
@@ -206,10 +2671,10 @@ class Allocator {
          * O(1) in space
          * O(1) in time
          */
-        void construct (pointer p, const_reference v) {
-            new (p) T(v);                               // this is correct and exempt
-            assert(valid());}                           // from the prohibition of new
-
+        template <typename U, typename... Args>
+        void construct (U* p, Args&&... args) {
+            new (p) U(std::forward<Args>(args)...);}    // this is correct and exempt
+                                                        // from the prohibition of new
         // ----------
         // deallocate
         // ----------
@@ -217,71 +2682,11 @@ class Allocator {
         /**
          * O(1) in space
          * O(1) in time
-         * after deallocation adjacent free blocks must be coalesced
+         * n must be the n p was allocated with
          * throw an invalid_argument exception, if p is invalid
-         * deallocate memory starting on the pointer passed to the method
-         * get the value of the block to deallocate and check if the prev
-         * and next block are free checking the sentinel value is positive
-         * if the adjacent blocks are free then coalesces then all in one
-         * free block making the front and the back sentinel a positive value
-         * of the size of the block, without the 2 int sizes of the sentinels
          */
-        void deallocate (pointer p, size_type) {
-
-            if (p == 0)
-                return;
-
-            char* _p = (char*)p;
-            int idx = _p - &a[0];
-            
-            if ((_p < &a[sizeof(int)]) || (_p > &a[N - sizeof(int)] - 1))
-                throw invalid_argument("Invalid pointer - Pointer is not inside pool");
-            
-            int& front_sentinel = (*this)[idx - sizeof(int)];            
-            int positive_sentinel = front_sentinel < 0 ? (-1 * front_sentinel) : front_sentinel;
-            int total_sentinel = positive_sentinel;
-            int& back_sentinel = (*this)[idx + positive_sentinel];
-            bool done = false;
-            
-            if (front_sentinel != back_sentinel)
-                throw invalid_argument("Invalid pointer - Pointer is not valid starting address block");
-
-            if ((_p - (3 * sizeof(int))) > &a[0]) {
-
-                int& prev_back_sentinel = (*this)[idx - (2 * sizeof(int))];
-                
-                if (prev_back_sentinel >= 0) {
-                    int& prev_front_sentinel = (*this)[idx - (3 * sizeof(int)) - prev_back_sentinel];
-                    total_sentinel = prev_back_sentinel + (2 * sizeof(int) + positive_sentinel);
-                    prev_front_sentinel = total_sentinel;
-                    back_sentinel = total_sentinel;
-                    done = true;
-                }
-            }
-
-            if ((_p + positive_sentinel + (3 * sizeof(int))) < &a[N]) {
-
-                int& next_front_sentinel = (*this)[idx + positive_sentinel + sizeof(int)];
-                
-                if ((next_front_sentinel) >= 0) {
-                    total_sentinel = total_sentinel + (2 * sizeof(int) + next_front_sentinel);
-                    int& next_back_sentinel = (*this)[idx + positive_sentinel + (2 * (sizeof(int))) + next_front_sentinel];
-                    if (done) {
-                        (*this)[idx - (3 * sizeof(int)) - (*this)[idx - (2 * sizeof(int))]] = total_sentinel;
-                    }
-                    else front_sentinel = total_sentinel;
-                    next_back_sentinel = total_sentinel;
-                    done = true;
-                }
-            }
-
-            if (!done) {
-                front_sentinel = total_sentinel;
-                back_sentinel = total_sentinel;
-            }
-
-            assert(valid());}
-            
+        void deallocate (pointer p, size_type n) {
+            slabs->deallocate_bytes(reinterpret_cast<char*>(p), n * sizeof(T), alignof(T));}
 
         // -------
         // destroy
@@ -291,17 +2696,8 @@ class Allocator {
          * O(1) in space
          * O(1) in time
          */
-        void destroy (pointer p) {
-            p->~T();               // this is correct
-            assert(valid());}
-
-        /**
-         * O(1) in space
-         * O(1) in time
-         * public [] operator, it is inmutable. We don't want anybody
-         * changes [] operator. 
-         */
-        const int& operator [] (int i) const {
-            return *reinterpret_cast<const int*>(&a[i]);}};
+        template <typename U>
+        void destroy (U* p) {
+            p->~U();}};            // this is correct
 
 #endif // Allocator_h
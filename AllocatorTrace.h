@@ -0,0 +1,187 @@
+// -----------------------------------
+// projects/allocator/AllocatorTrace.h
+// Copyright (C) 2015
+// Glenn P. Downing
+// -----------------------------------
+
+#ifndef AllocatorTrace_h
+#define AllocatorTrace_h
+
+// --------
+// includes
+// --------
+
+#include <algorithm> // sort
+#include <chrono>    // duration_cast, nanoseconds, steady_clock
+#include <cstddef>   // size_t
+#include <istream>   // istream
+#include <new>       // bad_alloc
+#include <ostream>   // ostream
+#include <sstream>   // istringstream
+#include <stdexcept> // invalid_argument
+#include <string>    // getline, string
+#include <vector>    // vector
+
+// --------
+// trace_op
+// --------
+
+/**
+ * one operation of a trace, allocate bytes under id, or free the block
+ * allocated under id
+ * a trace is text, one operation a line, "a <id> <bytes>" or "f <id>",
+ * ids are small non negative ints, reused once freed, blank lines and
+ * lines starting with # are skipped
+ */
+struct trace_op {
+    char        kind;
+    int         id;
+    std::size_t bytes;};
+
+// ----------
+// read_trace
+// ----------
+
+/**
+ * O(t) in space
+ * O(t) in time, t the number of operations
+ * throw an invalid_argument exception, if a line is not an operation, or
+ * frees an id that is not allocated, or allocates one that is
+ */
+inline std::vector<trace_op> read_trace (std::istream& in) {
+    std::vector<trace_op> ops;
+    std::vector<bool>     live;
+    std::string line;
+    int n = 0;
+    while (std::getline(in, line)) {
+        ++n;
+        if (line.empty() || (line[0] == '#'))
+            continue;
+        std::istringstream sin(line);
+        trace_op op = {0, -1, 0};
+        std::string rest;
+        sin >> op.kind >> op.id;
+        if ((op.kind == 'a') && sin)
+            sin >> op.bytes;
+        if (!sin || (op.id < 0) || ((op.kind != 'a') && (op.kind != 'f')) ||
+            ((op.kind == 'a') && (op.bytes == 0)) || (sin >> rest))
+            throw std::invalid_argument("Invalid trace - Line " + std::to_string(n) + " is not an operation");
+        if (op.id >= static_cast<int>(live.size()))
+            live.resize(op.id + 1, false);
+        if (live[op.id] != (op.kind == 'f'))
+            throw std::invalid_argument("Invalid trace - Line " + std::to_string(n) + (live[op.id] ? " allocates a live id" : " frees an id that is not allocated"));
+        live[op.id] = !live[op.id];
+        ops.push_back(op);}
+    return ops;}
+
+// -----------
+// write_trace
+// -----------
+
+/**
+ * O(1) in space
+ * O(t) in time, t the number of operations
+ */
+inline void write_trace (std::ostream& out, const std::vector<trace_op>& ops) {
+    for (std::size_t i = 0; i != ops.size(); ++i) {
+        if (ops[i].kind == 'a')
+            out << "a " << ops[i].id << " " << ops[i].bytes << "\n";
+        else
+            out << "f " << ops[i].id << "\n";}}
+
+// -------------
+// replay_result
+// -------------
+
+/**
+ * operations replayed, allocations that failed, wall time, and the
+ * latency of one operation in nanoseconds, median, 99th percentile, and
+ * worst
+ */
+struct replay_result {
+    long   operations;
+    long   failures;
+    double seconds;
+    long   p50;
+    long   p99;
+    long   max;
+
+    double ops_per_second () const {
+        return seconds == 0.0 ? 0.0 : operations / seconds;}};
+
+// ------
+// replay
+// ------
+
+/**
+ * O(t) in space
+ * O(t) operations of x in time, t the number of operations
+ * run the trace, a valid one as read_trace() returns, against x, an
+ * allocator of char, timing every operation, an allocation that returns
+ * 0 or throws bad_alloc is a failure, and the free of its id is skipped
+ * at_end() is called once the trace is done, before the blocks it left
+ * live are freed, to look at x as the trace left it
+ */
+template <typename A, typename F>
+replay_result replay (A& x, const std::vector<trace_op>& ops, F at_end) {
+    typedef std::chrono::steady_clock clock;
+
+    int ids = 0;
+    for (std::size_t i = 0; i != ops.size(); ++i)
+        if (ops[i].id >= ids)
+            ids = ops[i].id + 1;
+
+    enum state {none, live, failed};
+    std::vector<char*>       blocks(ids, 0);
+    std::vector<std::size_t> sizes(ids, 0);
+    std::vector<state>       states(ids, none);
+    std::vector<long>        latencies;
+    latencies.reserve(ops.size());
+
+    replay_result r = {0, 0, 0.0, 0, 0, 0};
+    const clock::time_point b = clock::now();
+    for (std::size_t i = 0; i != ops.size(); ++i) {
+        const trace_op& op = ops[i];
+        if (op.kind == 'a') {
+            char* p = 0;
+            const clock::time_point t = clock::now();
+            try {
+                p = x.allocate(op.bytes);}
+            catch (const std::bad_alloc&)
+                {}
+            latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t).count());
+            blocks[op.id] = p;
+            sizes[op.id]  = op.bytes;
+            states[op.id] = (p == 0) ? failed : live;
+            if (p == 0)
+                ++r.failures;}
+        else {
+            if (states[op.id] == live) {
+                const clock::time_point t = clock::now();
+                x.deallocate(blocks[op.id], sizes[op.id]);
+                latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t).count());}
+            states[op.id] = none;}}
+    r.seconds = std::chrono::duration<double>(clock::now() - b).count();
+
+    at_end();
+    for (int id = 0; id != ids; ++id)
+        if (states[id] == live)
+            x.deallocate(blocks[id], sizes[id]);
+
+    r.operations = latencies.size();
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        r.p50 = latencies[latencies.size() / 2];
+        r.p99 = latencies[(latencies.size() * 99) / 100];
+        r.max = latencies.back();}
+    return r;}
+
+struct replay_done {
+    void operator () () const
+        {}};
+
+template <typename A>
+replay_result replay (A& x, const std::vector<trace_op>& ops) {
+    return replay(x, ops, replay_done());}
+
+#endif // AllocatorTrace_h
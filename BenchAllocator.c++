@@ -0,0 +1,175 @@
+// -------------------------------------
+// projects/allocator/BenchAllocator.c++
+// Copyright (C) 2015
+// Glenn P. Downing
+// -------------------------------------
+
+// --------
+// includes
+// --------
+
+#include <cstdio>    // printf
+#include <cstring>   // strcmp
+#include <iostream>  // cerr, cout
+#include <memory>    // allocator, unique_ptr
+#include <random>    // mt19937, uniform_int_distribution
+#include <string>    // string
+#include <vector>    // vector
+
+#include "Allocator.h"
+#include "AllocatorTrace.h"
+
+/**
+ * bytes of every Allocator the workloads run against, the live blocks of
+ * every workload fit in it, unless fragmentation gets in the way
+ */
+const std::size_t bench_size = 1 << 20;
+
+// ---------
+// workloads
+// ---------
+
+/**
+ * rounds of 64 blocks of 16 to 128 bytes, freed in reverse order
+ */
+std::vector<trace_op> lifo (std::mt19937& g) {
+    std::uniform_int_distribution<int> size(16, 128);
+    std::vector<trace_op> ops;
+    for (int round = 0; round != 2000; ++round) {
+        for (int id = 0; id != 64; ++id) {
+            const trace_op op = {'a', id, static_cast<std::size_t>(size(g))};
+            ops.push_back(op);}
+        for (int id = 63; id != -1; --id) {
+            const trace_op op = {'f', id, 0};
+            ops.push_back(op);}}
+    return ops;}
+
+/**
+ * a queue of 512 blocks of 16 to 128 bytes, the oldest is freed before
+ * every allocation
+ */
+std::vector<trace_op> fifo (std::mt19937& g) {
+    std::uniform_int_distribution<int> size(16, 128);
+    std::vector<trace_op> ops;
+    for (int step = 0; step != 128000; ++step) {
+        const int id = step % 512;
+        if (step >= 512) {
+            const trace_op op = {'f', id, 0};
+            ops.push_back(op);}
+        const trace_op op = {'a', id, static_cast<std::size_t>(size(g))};
+        ops.push_back(op);}
+    return ops;}
+
+/**
+ * up to 1000 live blocks of 8 to 1024 bytes, every step frees a random
+ * live block or allocates one
+ */
+std::vector<trace_op> churn (std::mt19937& g) {
+    std::uniform_int_distribution<int> size(8, 1024);
+    std::uniform_int_distribution<int> pick(0, 999);
+    std::vector<bool> live(1000, false);
+    std::vector<trace_op> ops;
+    for (int step = 0; step != 256000; ++step) {
+        const int id = pick(g);
+        const trace_op op = {live[id] ? 'f' : 'a', id, live[id] ? 0 : static_cast<std::size_t>(size(g))};
+        ops.push_back(op);
+        live[id] = !live[id];}
+    return ops;}
+
+/**
+ * rounds of 2048 blocks of 64 bytes, every other one freed, then 512
+ * blocks of 256 bytes that do not fit the holes left, then all freed
+ */
+std::vector<trace_op> fragmentation (std::mt19937&) {
+    std::vector<trace_op> ops;
+    for (int round = 0; round != 40; ++round) {
+        for (int id = 0; id != 2048; ++id) {
+            const trace_op op = {'a', id, 64};
+            ops.push_back(op);}
+        for (int id = 0; id < 2048; id += 2) {
+            const trace_op op = {'f', id, 0};
+            ops.push_back(op);}
+        for (int id = 2048; id != 2560; ++id) {
+            const trace_op op = {'a', id, 256};
+            ops.push_back(op);}
+        for (int id = 1; id < 2048; id += 2) {
+            const trace_op op = {'f', id, 0};
+            ops.push_back(op);}
+        for (int id = 2048; id != 2560; ++id) {
+            const trace_op op = {'f', id, 0};
+            ops.push_back(op);}}
+    return ops;}
+
+struct workload {
+    const char*           name;
+    std::vector<trace_op> (*make) (std::mt19937&);};
+
+const workload workloads[] = {
+    {"lifo",          lifo},
+    {"fifo",          fifo},
+    {"churn",         churn},
+    {"fragmentation", fragmentation}};
+
+// ---
+// run
+// ---
+
+void report (const char* name, const char* allocator, const replay_result& r) {
+    std::printf("%-14s %-24s %12.0f %8ld %8ld %10ld %8ld\n",
+                name, allocator, r.ops_per_second(), r.p50, r.p99, r.max, r.failures);}
+
+/**
+ * the Allocator is too big for the stack, it lives on the free store
+ */
+template <typename A>
+void run (const char* name, const char* allocator, const std::vector<trace_op>& ops) {
+    std::unique_ptr<A> x(new A);
+    report(name, allocator, replay(*x, ops));}
+
+// ----
+// main
+// ----
+
+/**
+ * BenchAllocator [workload ...]
+ *     runs the workloads, all of them by default, against std::allocator
+ *     and Allocator with each placement policy, and reports operations
+ *     per second, latency of one operation in nanoseconds, and failed
+ *     allocations
+ * BenchAllocator --trace workload
+ *     writes the trace of the workload, for ReplayAllocator
+ * build it with NDEBUG, or every operation runs a full valid()
+ */
+int main (int argc, char* argv[]) {
+    const int count = sizeof(workloads) / sizeof(workloads[0]);
+
+    if ((argc == 3) && (std::strcmp(argv[1], "--trace") == 0)) {
+        for (int w = 0; w != count; ++w) {
+            if (std::string(argv[2]) == workloads[w].name) {
+                std::mt19937 g(2015);
+                write_trace(std::cout, workloads[w].make(g));
+                return 0;}}
+        std::cerr << "BenchAllocator: unknown workload " << argv[2] << "\n";
+        return 1;}
+
+#ifndef NDEBUG
+    std::cerr << "BenchAllocator: built without NDEBUG, Allocator checks the whole pool on every operation\n";
+#endif
+
+    std::printf("%-14s %-24s %12s %8s %8s %10s %8s\n",
+                "workload", "allocator", "ops/sec", "p50 ns", "p99 ns", "max ns", "failed");
+    for (int w = 0; w != count; ++w) {
+        bool chosen = (argc == 1);
+        for (int i = 1; i != argc; ++i)
+            chosen = chosen || (std::string(argv[i]) == workloads[w].name);
+        if (!chosen)
+            continue;
+
+        std::mt19937 g(2015);
+        const std::vector<trace_op> ops = workloads[w].make(g);
+        run<std::allocator<char> >                          (workloads[w].name, "std::allocator",           ops);
+        run<Allocator<char, bench_size> >                   (workloads[w].name, "Allocator first_fit",      ops);
+        run<Allocator<char, bench_size, next_fit> >         (workloads[w].name, "Allocator next_fit",       ops);
+        run<Allocator<char, bench_size, best_fit> >         (workloads[w].name, "Allocator best_fit",       ops);
+        run<Allocator<char, bench_size, segregated_fit> >   (workloads[w].name, "Allocator segregated_fit", ops);}
+    return 0;}
@@ -0,0 +1,125 @@
+// --------------------------------------
+// projects/allocator/ReplayAllocator.c++
+// Copyright (C) 2015
+// Glenn P. Downing
+// --------------------------------------
+
+// --------
+// includes
+// --------
+
+#include <cstdio>    // printf
+#include <cstdlib>   // strtoul
+#include <cstring>   // strcmp
+#include <fstream>   // ifstream
+#include <iostream>  // cerr, cout
+#include <memory>    // allocator
+#include <sstream>   // ostringstream
+#include <stdexcept> // invalid_argument
+#include <string>    // string
+#include <vector>    // vector
+
+#include "Allocator.h"
+#include "AllocatorTrace.h"
+
+void report (const char* allocator, const replay_result& r) {
+    std::printf("%-24s %12.0f %8ld %8ld %10ld %8ld\n",
+                allocator, r.ops_per_second(), r.p50, r.p99, r.max, r.failures);}
+
+// ------------
+// replay_arena
+// ------------
+
+/**
+ * replay the trace against a HeapArena of size bytes, so the pool is
+ * sized at run time, then print its statistics, and its block map if
+ * dump is set, as the trace left them
+ */
+template <typename P>
+void replay_arena (const char* name, const std::vector<trace_op>& ops, std::size_t size, bool dump) {
+    typedef HeapArena<alignof(std::max_align_t), P, default_check, boundary_tags, counting_stats> arena_type;
+
+    arena_type r(size);
+    ArenaAllocator<char, arena_type> x(r);
+    heap_stats s;
+    std::string map;
+    report(name, replay(x, ops, [&] () {
+        s = r.statistics();
+        if (dump) {
+            std::ostringstream out;
+            r.dump(out);
+            map = out.str();}}));
+
+    std::printf("\nat the end of the trace\n");
+    std::printf("allocations   %ld\n", s.allocations);
+    std::printf("frees         %ld\n", s.frees);
+    std::printf("bytes in use  %ld\n", s.bytes_in_use);
+    std::printf("high water    %ld of %lu bytes\n", s.high_water, static_cast<unsigned long>(size));
+    std::printf("free blocks   %d\n", s.free_blocks);
+    std::printf("largest free  %d\n", s.largest_free);
+    std::printf("fragmentation %.3f\n", s.fragmentation);
+    std::printf("blocks visited per scan\n");
+    for (int k = 0; k != heap_stats::buckets; ++k)
+        if (s.scans[k] != 0)
+            std::printf("    %5d - %5d %ld\n", k == 0 ? 0 : 1 << (k - 1), k == 0 ? 0 : (1 << k) - 1, s.scans[k]);
+    if (dump)
+        std::printf("\n%s", map.c_str());}
+
+// ----
+// main
+// ----
+
+/**
+ * ReplayAllocator trace size [first_fit | next_fit | best_fit | segregated_fit] [--dump]
+ *     replays the trace, as written by BenchAllocator --trace, against
+ *     std::allocator and against a pool of size bytes with the placement
+ *     policy, first_fit by default, and reports operations per second,
+ *     latency of one operation in nanoseconds, failed allocations, and
+ *     the statistics of the pool, and its block map with --dump
+ * build it with and without NDEBUG, or with a different Allocator.h, to
+ * compare configurations on the same trace
+ */
+int main (int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: ReplayAllocator trace size [first_fit | next_fit | best_fit | segregated_fit] [--dump]\n";
+        return 1;}
+
+    std::string policy = "first_fit";
+    bool        dump   = false;
+    for (int i = 3; i != argc; ++i) {
+        if (std::strcmp(argv[i], "--dump") == 0)
+            dump = true;
+        else
+            policy = argv[i];}
+
+    std::ifstream in(argv[1]);
+    if (!in) {
+        std::cerr << "ReplayAllocator: can not read " << argv[1] << "\n";
+        return 1;}
+
+    try {
+        const std::vector<trace_op> ops  = read_trace(in);
+        const std::size_t           size = std::strtoul(argv[2], 0, 10);
+
+        std::printf("%-24s %12s %8s %8s %10s %8s\n", "allocator", "ops/sec", "p50 ns", "p99 ns", "max ns", "failed");
+        std::allocator<char> x;
+        report("std::allocator", replay(x, ops));
+
+        if (policy == "first_fit")
+            replay_arena<first_fit>     ("Allocator first_fit",      ops, size, dump);
+        else if (policy == "next_fit")
+            replay_arena<next_fit>      ("Allocator next_fit",       ops, size, dump);
+        else if (policy == "best_fit")
+            replay_arena<best_fit>      ("Allocator best_fit",       ops, size, dump);
+        else if (policy == "segregated_fit")
+            replay_arena<segregated_fit>("Allocator segregated_fit", ops, size, dump);
+        else {
+            std::cerr << "ReplayAllocator: unknown placement policy " << policy << "\n";
+            return 1;}}
+    catch (const std::invalid_argument& e) {
+        std::cerr << "ReplayAllocator: " << e.what() << "\n";
+        return 1;}
+    catch (const std::bad_alloc&) {
+        std::cerr << "ReplayAllocator: the pool can not be " << argv[2] << " bytes\n";
+        return 1;}
+    return 0;}
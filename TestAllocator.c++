@@ -9,11 +9,21 @@
 // --------
 
 #include <algorithm> // count
+#include <atomic>    // atomic
+#include <cstdint>   // int16_t, int32_t, uint16_t, uint32_t
+#include <list>      // list
+#include <map>       // map
 #include <memory>    // allocator
+#include <sstream>   // ostringstream
+#include <string>    // string
+#include <thread>    // thread
+#include <type_traits> // is_same
+#include <vector>    // vector
 
 #include "gtest/gtest.h"
 
 #include "Allocator.h"
+#include "AllocatorTrace.h"
 
 // --------------
 // TestAllocator1
@@ -34,7 +44,13 @@ typedef testing::Types<
             std::allocator<int>,
             std::allocator<double>,
             Allocator<int,    100>,
-            Allocator<double, 100> >
+            Allocator<double, 100>,
+            Allocator<int,    100, segregated_fit>,
+            Allocator<int,    100, next_fit>,
+            Allocator<int,    100, best_fit>,
+            Allocator<int,    100, first_fit, check_local>,
+            Allocator<int,    100, first_fit, check_sampled<4> >,
+            Allocator<int,    100, first_fit, default_check, compact_tags<100> > >
         my_types_1;
 
 TYPED_TEST_CASE(TestAllocator1, my_types_1);
@@ -113,7 +129,12 @@ struct TestAllocator3 : testing::Test {
 
 typedef testing::Types<
             Allocator<int,    100>,
-            Allocator<double, 100> >
+            Allocator<double, 100>,
+            Allocator<int,    100, segregated_fit>,
+            Allocator<double, 100, segregated_fit>,
+            Allocator<double, 100, next_fit>,
+            Allocator<double, 100, best_fit>,
+            Allocator<double, 100, segregated_fit, default_check, compact_tags<100> > >
         my_types_2;
 
 TYPED_TEST_CASE(TestAllocator3, my_types_2);
@@ -187,10 +208,12 @@ TEST(TestAllocator4, allocate_2) {
     typedef Allocator<double, 200>::pointer pointer;
     Allocator<double, 200> x;
     const pointer p = x.allocate(s);
-    ASSERT_EQ(x[0], -72);
-    ASSERT_EQ(x[76], -72);
+
+    // The first payload is aligned for double, its sentinel is at 4
+    ASSERT_EQ(x[4], -72);
+    ASSERT_EQ(x[80], -72);
     x.deallocate(p, s);
-    ASSERT_EQ(x[196], 192);
+    ASSERT_EQ(x[192], 184);
 }
 
 
@@ -223,20 +246,20 @@ TEST(TestAllocator4, allocate_3) {
 TEST(TestAllocator4, allocate_4) {
     double s1 = 8;
     double s2 = 5;
-    typedef Allocator<double, 90>::pointer pointer;
-    Allocator<double, 90> x;
+    typedef Allocator<double, 106>::pointer pointer;
+    Allocator<double, 106> x;
     const pointer p1 = x.allocate(s1);
-    ASSERT_EQ(x[0], -64);
-    ASSERT_EQ(x[68], -64);
+    ASSERT_EQ(x[4], -64);
+    ASSERT_EQ(x[72], -64);
 
     // Remaining available memory
-    ASSERT_EQ(x[72], 10);
+    ASSERT_EQ(x[76], 16);
 
     // Allocator will need at least 48 bytes to allocate s2
     // s2 does not fit, then nothing change on sentinels
     // and p2 is null;
     const pointer p2 = x.allocate(s2);
-    ASSERT_EQ(x[72], 10);
+    ASSERT_EQ(x[76], 16);
     ASSERT_EQ(p2, nullptr);
 
     x.deallocate(p1, s1);
@@ -393,9 +416,10 @@ TEST(TestAllocator4, Allocator_1) {
 }
 
 TEST(TestAllocator4, Allocator_2) {
+    // Aligned for double, the 2 bytes after the last block are not used
     Allocator<double, 150> x;
-    ASSERT_EQ(x[0], 142);
-    ASSERT_EQ(x[146], 142);
+    ASSERT_EQ(x[4], 136);
+    ASSERT_EQ(x[144], 136);
 }
 
 /** ---------------------------------------
@@ -412,4 +436,1382 @@ TEST(TestAllocator4, Allocator_3) {
     }
     
     ASSERT_EQ(my_catch, "There is not the minimum required space for allocation");
-}
\ No newline at end of file
+}
+
+/** ---------------------------------------
+ * free list - links only the free blocks
+ * ---------------------------------------*/
+
+TEST(TestAllocator5, free_list_1) {
+    Allocator<int, 100> x;
+    ASSERT_EQ(x.free_list.head, 0);
+    ASSERT_EQ(x.next_link(0), -1);
+    ASSERT_EQ(x.prev_link(0), -1);
+}
+
+TEST(TestAllocator5, free_list_2) {
+    typedef Allocator<int, 100>::pointer pointer;
+    Allocator<int, 100> x;
+    const pointer p1 = x.allocate(2);
+    const pointer p2 = x.allocate(2);
+    const pointer p3 = x.allocate(2);
+
+    // Only the tail of the pool is free
+    ASSERT_EQ(x.free_list.head, 48);
+
+    x.deallocate(p1, 2);
+    x.deallocate(p3, 2);
+
+    // p3 coalesced with the tail, p1 is on its own, p2 is never visited
+    ASSERT_EQ(x.free_list.head, 32);
+    ASSERT_EQ(x[32], 60);
+    ASSERT_EQ(x.next_link(32), 0);
+    ASSERT_EQ(x.prev_link(0), 32);
+    ASSERT_EQ(x.next_link(0), -1);
+
+    x.deallocate(p2, 2);
+    ASSERT_EQ(x.free_list.head, 0);
+    ASSERT_EQ(x[0], 92);
+    ASSERT_EQ(x.next_link(0), -1);
+}
+
+/** ---------------------------------------
+ * free list - blocks are big enough for the links
+ * ---------------------------------------*/
+
+TEST(TestAllocator5, min_payload_1) {
+    typedef Allocator<char, 100>::pointer pointer;
+    Allocator<char, 100> x;
+    const pointer p = x.allocate(1);
+    ASSERT_EQ(x[0], -8);
+    ASSERT_EQ(x[12], -8);
+    x.deallocate(p, 1);
+    ASSERT_EQ(x[0], 92);
+}
+
+TEST(TestAllocator5, min_payload_2) {
+    // A remainder of 4 bytes can not hold a free block, hand out all of it
+    typedef Allocator<int, 32>::pointer pointer;
+    Allocator<int, 32> x;
+    const pointer p = x.allocate(3);
+    ASSERT_EQ(x[0], -24);
+    ASSERT_EQ(x[28], -24);
+    ASSERT_EQ(x.free_list.head, -1);
+    ASSERT_EQ(x.allocate(1), nullptr);
+    x.deallocate(p, 3);
+    ASSERT_EQ(x[0], 24);
+}
+
+/** ---------------------------------------
+ * deallocate() - throws on a double free
+ * ---------------------------------------*/
+
+TEST(TestAllocator5, deallocate_1) {
+    typedef Allocator<int, 100>::pointer pointer;
+    Allocator<int, 100> x;
+    const pointer p1 = x.allocate(5);
+    const pointer p2 = x.allocate(5);
+    x.deallocate(p1, 5);
+    ASSERT_THROW(x.deallocate(p1, 5), invalid_argument);
+    x.deallocate(p2, 5);
+    ASSERT_EQ(x[0], 92);
+}
+
+
+/** ---------------------------------------
+ * segregated_fit - size classes
+ * ---------------------------------------*/
+
+TEST(TestAllocator6, mapping_1) {
+    int fl, sl;
+    segregated_fit::mapping(8, fl, sl);
+    ASSERT_EQ(fl, 0);
+    ASSERT_EQ(sl, 2);
+    segregated_fit::mapping(92, fl, sl);
+    ASSERT_EQ(fl, 2);
+    ASSERT_EQ(sl, 3);
+    segregated_fit::mapping(1000, fl, sl);
+    ASSERT_EQ(fl, 5);
+    ASSERT_EQ(sl, 7);
+}
+
+TEST(TestAllocator6, mapping_2) {
+    // Searching rounds up, every block of the class found fits
+    int fl, sl;
+    segregated_fit::mapping_search(9, fl, sl);
+    ASSERT_EQ(fl, 0);
+    ASSERT_EQ(sl, 3);
+    segregated_fit::mapping_search(88, fl, sl);
+    ASSERT_EQ(fl, 2);
+    ASSERT_EQ(sl, 3);
+    segregated_fit::mapping_search(89, fl, sl);
+    ASSERT_EQ(fl, 2);
+    ASSERT_EQ(sl, 4);
+}
+
+/** ---------------------------------------
+ * segregated_fit - allocate() and deallocate()
+ * ---------------------------------------*/
+
+TEST(TestAllocator6, allocate_1) {
+    typedef Allocator<int, 100, segregated_fit>::pointer pointer;
+    Allocator<int, 100, segregated_fit> x;
+    ASSERT_EQ(x.free_list.fl_bitmap, 1u << 2);
+    ASSERT_EQ(x.free_list.sl_bitmap[2], 1u << 3);
+    ASSERT_EQ(x.free_list.bins[2][3], 0);
+
+    const pointer p = x.allocate(10);
+    ASSERT_EQ(x[0], -40);
+    ASSERT_EQ(x[48], 44);
+    ASSERT_EQ(x.free_list.fl_bitmap, 1u << 1);
+    ASSERT_EQ(x.free_list.sl_bitmap[1], 1u << 3);
+    ASSERT_EQ(x.free_list.bins[1][3], 48);
+
+    x.deallocate(p, 10);
+    ASSERT_EQ(x[0], 92);
+    ASSERT_EQ(x.free_list.bins[2][3], 0);
+    ASSERT_EQ(x.free_list.bins[1][3], -1);
+}
+
+TEST(TestAllocator6, allocate_2) {
+    // The whole pool, only found through the class of the request
+    typedef Allocator<int, 100, segregated_fit>::pointer pointer;
+    Allocator<int, 100, segregated_fit> x;
+    const pointer p = x.allocate(23);
+    ASSERT_NE(p, nullptr);
+    ASSERT_EQ(x[0], -92);
+    ASSERT_EQ(x.free_list.fl_bitmap, 0u);
+    ASSERT_EQ(x.allocate(1), nullptr);
+    x.deallocate(p, 23);
+    ASSERT_EQ(x[0], 92);
+}
+
+TEST(TestAllocator6, deallocate_1) {
+    typedef Allocator<int, 200, segregated_fit>::pointer pointer;
+    Allocator<int, 200, segregated_fit> x;
+    pointer p[6];
+    for (int i = 0; i != 6; ++i)
+        p[i] = x.allocate(i + 2);
+    for (int i = 0; i < 6; i += 2)
+        x.deallocate(p[i], i + 2);
+    ASSERT_TRUE(x.valid());
+    for (int i = 1; i < 6; i += 2)
+        x.deallocate(p[i], i + 2);
+    ASSERT_EQ(x[0], 192);
+    ASSERT_EQ(x.free_list.count(x), 1);
+}
+
+
+/** ---------------------------------------
+ * next_fit - roving cursor
+ * ---------------------------------------*/
+
+TEST(TestAllocator7, next_fit_1) {
+    typedef Allocator<int, 200, next_fit>::pointer pointer;
+    Allocator<int, 200, next_fit> x;
+    pointer p[4];
+    for (int i = 0; i != 4; ++i)
+        p[i] = x.allocate(4);
+    x.deallocate(p[0], 4);
+    x.deallocate(p[2], 4);
+
+    // Free list is 48, 0, 96 (the tail), the last search stopped at 96
+    ASSERT_EQ(x.free_list.head, 48);
+    ASSERT_EQ(x.free_list.rover, 96);
+
+    // The cursor survives, the search starts at the tail, not at the head
+    const pointer q = x.allocate(4);
+    ASSERT_EQ(reinterpret_cast<char*>(q) - &x.a[0], 100);
+    ASSERT_EQ(x[48], 16);
+    ASSERT_EQ(x[0], 16);
+}
+
+TEST(TestAllocator7, next_fit_2) {
+    // The cursor moves on when deallocate() coalesces over its block
+    typedef Allocator<int, 200, next_fit>::pointer pointer;
+    Allocator<int, 200, next_fit> x;
+    const pointer p1 = x.allocate(4);
+    const pointer p2 = x.allocate(4);
+    x.deallocate(p1, 4);
+    ASSERT_EQ(x.free_list.head, 0);
+    x.free_list.rover = 0;
+
+    x.deallocate(p2, 4);
+    ASSERT_EQ(x[0], 192);
+    ASSERT_EQ(x.free_list.head, 0);
+    ASSERT_NE(x.free_list.rover, 0);
+    ASSERT_TRUE(x.valid());
+    ASSERT_NE(x.allocate(4), nullptr);
+}
+
+/** ---------------------------------------
+ * best_fit - smallest block that fits
+ * ---------------------------------------*/
+
+TEST(TestAllocator7, best_fit_1) {
+    typedef Allocator<int, 200, best_fit>::pointer pointer;
+    Allocator<int, 200, best_fit> x;
+    const pointer p1 = x.allocate(8);
+    const pointer p2 = x.allocate(1);
+    const pointer p3 = x.allocate(4);
+    const pointer p4 = x.allocate(1);
+    x.deallocate(p1, 8);
+    x.deallocate(p3, 4);
+
+    // Blocks of 32 at 0, of 16 at 48 and the tail are free
+    const pointer q = x.allocate(4);
+    ASSERT_EQ(q, p3);
+    ASSERT_EQ(x[0], 32);
+    x.deallocate(q, 4);
+    x.deallocate(p2, 1);
+    x.deallocate(p4, 1);
+    ASSERT_EQ(x[0], 192);
+}
+
+/** ---------------------------------------
+ * fragmentation() - reported per policy
+ * ---------------------------------------*/
+
+template <typename A>
+double fragment () {
+    typedef typename A::pointer pointer;
+    A x;
+    pointer p[12];
+    for (int i = 0; i != 12; ++i)
+        p[i] = x.allocate((i % 3) + 1);
+    for (int i = 0; i < 12; i += 2)
+        x.deallocate(p[i], (i % 3) + 1);
+    for (int i = 0; i != 4; ++i)
+        x.allocate(2);
+    return x.fragmentation();}
+
+TEST(TestAllocator7, fragmentation_1) {
+    Allocator<int, 300> x;
+    ASSERT_EQ(x.fragmentation(), 0.0);
+    typedef Allocator<int, 300>::pointer pointer;
+    const pointer p1 = x.allocate(4);
+    const pointer p2 = x.allocate(4);
+    x.deallocate(p1, 4);
+    ASSERT_GT(x.fragmentation(), 0.0);
+    ASSERT_LT(x.fragmentation(), 1.0);
+    x.deallocate(p2, 4);
+    ASSERT_EQ(x.fragmentation(), 0.0);
+}
+
+TEST(TestAllocator7, fragmentation_2) {
+    const double ff = fragment< Allocator<int, 400, first_fit> >();
+    const double nf = fragment< Allocator<int, 400, next_fit> >();
+    const double bf = fragment< Allocator<int, 400, best_fit> >();
+    const double sf = fragment< Allocator<int, 400, segregated_fit> >();
+    // Six holes of 8 and 12 bytes before a tail of 184 for 4 blocks of 8
+    // first_fit fills the holes it meets first on its list, leaving one
+    // of 8 and one of 12
+    ASSERT_DOUBLE_EQ(ff, 1.0 - (184.0 / (8 + 12 + 184)));
+    // best_fit and segregated_fit fill the holes of 8, leaving two of 12
+    ASSERT_DOUBLE_EQ(bf, 1.0 - (184.0 / (12 + 12 + 184)));
+    ASSERT_DOUBLE_EQ(sf, bf);
+    // next_fit goes on from the last block it handed out, into the tail,
+    // leaving every hole and a shorter tail
+    ASSERT_DOUBLE_EQ(nf, 1.0 - (120.0 / (8 + 12 + 8 + 8 + 12 + 8 + 120)));
+    ASSERT_LT(ff, bf);
+    ASSERT_LT(bf, nf);
+}
+
+
+/** ---------------------------------------
+ * checking policies - detect a corrupted pool
+ * ---------------------------------------*/
+
+TEST(TestAllocator8, check_none_1) {
+    typedef Allocator<int, 100, first_fit, check_none>::pointer pointer;
+    Allocator<int, 100, first_fit, check_none> x;
+    const pointer p1 = x.allocate(5);
+    const pointer p2 = x.allocate(5);
+    x[24] = -16;
+    ASSERT_FALSE(x.valid());
+    ASSERT_NO_THROW(x.deallocate(p2, 5));
+    x[24] = -20;
+    x.deallocate(p1, 5);
+}
+
+TEST(TestAllocator8, check_local_1) {
+    // The back sentinel of the block before the one deallocated is broken
+    typedef Allocator<int, 100, first_fit, check_local>::pointer pointer;
+    Allocator<int, 100, first_fit, check_local> x;
+    x.allocate(5);
+    const pointer p2 = x.allocate(5);
+    x[24] = -16;
+    ASSERT_THROW(x.deallocate(p2, 5), logic_error);
+}
+
+TEST(TestAllocator8, check_local_2) {
+    // A block away from the one touched is not looked at
+    typedef Allocator<int, 100, first_fit, check_local>::pointer pointer;
+    Allocator<int, 100, first_fit, check_local> x;
+    const pointer p1 = x.allocate(2);
+    const pointer p2 = x.allocate(2);
+    const pointer p3 = x.allocate(2);
+    x[12] = -4;
+    ASSERT_NO_THROW(x.deallocate(p3, 2));
+    ASSERT_FALSE(x.valid());
+    ASSERT_THROW(x.deallocate(p2, 2), logic_error);
+    x[12] = -8;
+    x.deallocate(p1, 2);
+}
+
+TEST(TestAllocator8, check_local_3) {
+    Allocator<int, 100, first_fit, check_local> x;
+    ASSERT_TRUE(x.valid_block(0));
+    x.allocate(2);
+    ASSERT_TRUE(x.valid_block(0));
+    ASSERT_TRUE(x.valid_block(16));
+    ASSERT_FALSE(x.valid_block(4));
+    x.next_link(16) = 0;
+    ASSERT_FALSE(x.valid_block(16));
+}
+
+TEST(TestAllocator8, check_sampled_1) {
+    // valid() only runs on every fourth operation, the constructor is the first
+    typedef Allocator<int, 100, first_fit, check_sampled<4> >::pointer pointer;
+    Allocator<int, 100, first_fit, check_sampled<4> > x;
+    const pointer p1 = x.allocate(5);
+    const pointer p2 = x.allocate(5);
+    x[24] = -16;
+    ASSERT_THROW(x.allocate(1), logic_error);
+    x[24] = -20;
+    ASSERT_NO_THROW(x.deallocate(p2, 5));
+    x.deallocate(p1, 5);
+    ASSERT_TRUE(x.valid());
+}
+
+TEST(TestAllocator8, check_full_1) {
+    typedef Allocator<int, 100, first_fit, check_full>::pointer pointer;
+    Allocator<int, 100, first_fit, check_full> x;
+    const pointer p1 = x.allocate(2);
+    const pointer p2 = x.allocate(2);
+    x.allocate(2);
+    x[12] = -4;
+    ASSERT_THROW(x.construct(p2, 1), logic_error);
+    x[12] = -8;
+    x.destroy(p2);
+    x.deallocate(p1, 2);
+}
+
+
+/** ---------------------------------------
+ * SharedAllocator - per thread caches
+ * ---------------------------------------*/
+
+TEST(TestAllocator9, cache_1) {
+    typedef SharedAllocator<int, 1000>::pointer pointer;
+    SharedAllocator<int, 1000> x;
+    const pointer p = x.allocate(2);
+    const int c = x.local();
+    ASSERT_NE(c, -1);
+
+    // A batch was taken from the heap, one handed out, the rest cached
+    ASSERT_EQ(x.caches[c].counts[1], 7);
+    x.construct(p, 3);
+    ASSERT_EQ(*p, 3);
+    x.destroy(p);
+    x.deallocate(p, 2);
+    ASSERT_EQ(x.caches[c].counts[1], 8);
+    ASSERT_EQ(x.allocate(2), p);
+
+    x.deallocate(p, 2);
+    x.flush();
+    const decltype(x.heap)& h = x.heap;
+    ASSERT_EQ(x.caches[c].counts[1], 0);
+    ASSERT_EQ(h[4], 984);
+    ASSERT_TRUE(x.valid());
+}
+
+TEST(TestAllocator9, cache_2) {
+    // Bigger requests and a full heap go through the lock
+    typedef SharedAllocator<int, 200>::pointer pointer;
+    SharedAllocator<int, 200> x;
+    const pointer p1 = x.allocate(20);
+    ASSERT_NE(p1, nullptr);
+    const pointer p2 = x.allocate(8);
+    ASSERT_NE(p2, nullptr);
+    ASSERT_EQ(x.allocate(20), nullptr);
+    x.deallocate(p1, 20);
+    x.deallocate(p2, 8);
+    x.flush();
+    const decltype(x.heap)& h = x.heap;
+    ASSERT_EQ(h[4], 184);
+}
+
+TEST(TestAllocator9, remote_1) {
+    // A block freed by another thread goes on the remote list of its owner
+    typedef SharedAllocator<int, 1000>::pointer pointer;
+    SharedAllocator<int, 1000> x;
+    const pointer p = x.allocate(1);
+    const int c = x.local();
+    std::thread t([&x, p] () {x.deallocate(p, 1);});
+    t.join();
+    ASSERT_EQ(x.caches[c].remote.load(), x.header(p));
+    ASSERT_EQ(x.caches[c].counts[0], 7);
+    x.drain(c);
+    ASSERT_EQ(x.caches[c].remote.load(), nullptr);
+    ASSERT_EQ(x.caches[c].counts[0], 8);
+    x.flush();
+    const decltype(x.heap)& h = x.heap;
+    ASSERT_EQ(h[4], 984);
+}
+
+TEST(TestAllocator9, remote_2) {
+    // A block freed after its owner flushed goes straight to the heap
+    typedef SharedAllocator<int, 1000>::pointer pointer;
+    SharedAllocator<int, 1000> x;
+    pointer p = nullptr;
+    std::thread a([&x, &p] () {
+        p = x.allocate(1);
+        x.flush();});
+    a.join();
+    const int c = x.header(p)->owner;
+    ASSERT_EQ(x.caches[c].remote.load(), x.orphaned());
+    std::thread b([&x, p] () {
+        x.deallocate(p, 1);
+        x.flush();});
+    b.join();
+    ASSERT_EQ(x.caches[c].remote.load(), x.orphaned());
+    const decltype(x.heap)& h = x.heap;
+    ASSERT_EQ(h[4], 984);
+    ASSERT_TRUE(x.valid());
+}
+
+/** ---------------------------------------
+ * SharedAllocator - many threads, one pool
+ * ---------------------------------------*/
+
+TEST(TestAllocator9, stress_1) {
+    typedef SharedAllocator<int, 20000>::pointer pointer;
+    const int threads = 4;
+    const int rounds  = 2000;
+    const int slots   = 16;
+    SharedAllocator<int, 20000> x;
+    std::atomic<pointer> handoff[threads];
+    std::atomic<int>     errors(0);
+    std::atomic<int>     done(0);
+    for (int i = 0; i != threads; ++i)
+        handoff[i].store(nullptr);
+
+    std::vector<std::thread> workers;
+    for (int id = 0; id != threads; ++id) {
+        workers.push_back(std::thread([&, id] () {
+            pointer held[slots] = {};
+            for (int r = 0; r != rounds; ++r) {
+                const int s = (r * 7 + id) % slots;
+                const int n = (s % 10) + 1;
+                if (held[s] != nullptr) {
+                    for (int i = 0; i != n; ++i)
+                        if (held[s][i] != id * 1000 + s)
+                            ++errors;
+                    // Every fourth block is freed by the next thread
+                    if (r % 4 == 0)
+                        held[s] = handoff[(id + 1) % threads].exchange(held[s]);
+                    if (held[s] != nullptr)
+                        x.deallocate(held[s], n);
+                    held[s] = nullptr;
+                    const pointer p = handoff[id].exchange(nullptr);
+                    if (p != nullptr)
+                        x.deallocate(p, 1);}
+                else {
+                    held[s] = x.allocate(n);
+                    if (held[s] != nullptr)
+                        for (int i = 0; i != n; ++i)
+                            held[s][i] = id * 1000 + s;}}
+            for (int s = 0; s != slots; ++s)
+                if (held[s] != nullptr)
+                    x.deallocate(held[s], (s % 10) + 1);
+            ++done;
+            while (done.load() != threads)
+                std::this_thread::yield();
+            pointer p = handoff[id].exchange(nullptr);
+            if (p != nullptr)
+                x.deallocate(p, 1);
+            x.flush();}));}
+
+    for (int i = 0; i != threads; ++i)
+        workers[i].join();
+
+    ASSERT_EQ(errors.load(), 0);
+    ASSERT_TRUE(x.valid());
+
+    // Every block, cached, remote, or handed off, is back in the heap
+    const decltype(x.heap)& h = x.heap;
+    ASSERT_EQ(h[4], 19984);
+}
+
+
+/** ---------------------------------------
+ * alignment - payloads aligned for T
+ * ---------------------------------------*/
+
+struct alignas(32) vector4 {
+    double v[4];};
+
+bool aligned (const void* p, std::size_t alignment) {
+    return (reinterpret_cast<std::size_t>(p) % alignment) == 0;}
+
+TEST(TestAllocator10, align_1) {
+    typedef Allocator<double, 200>::pointer pointer;
+    Allocator<double, 200> x;
+    ASSERT_EQ(reinterpret_cast<std::size_t>(&x.a[0]) % alignof(std::max_align_t), 0u);
+    pointer p[5];
+    for (int i = 0; i != 5; ++i) {
+        p[i] = x.allocate(i + 1);
+        ASSERT_TRUE(aligned(p[i], alignof(double)));}
+    for (int i = 0; i != 5; ++i)
+        x.deallocate(p[i], i + 1);
+    ASSERT_EQ(x[4], 184);
+}
+
+TEST(TestAllocator10, align_2) {
+    // Blocks are rounded up so the next payload is aligned too
+    typedef Allocator<char, 100>::pointer pointer;
+    Allocator<char, 100> x;
+    const pointer p1 = x.allocate(9);
+    const pointer p2 = x.allocate(1);
+    ASSERT_EQ(x[0], -12);
+    ASSERT_EQ(p2 - p1, 20);
+    ASSERT_TRUE(aligned(p2, sizeof(int)));
+    x.deallocate(p1, 9);
+    x.deallocate(p2, 1);
+}
+
+TEST(TestAllocator10, align_3) {
+    // Over aligned type, the first sentinel is at 28
+    typedef Allocator<vector4, 400>::pointer pointer;
+    Allocator<vector4, 400> x;
+    ASSERT_EQ(x[28], 344);
+    const pointer p1 = x.allocate(1);
+    const pointer p2 = x.allocate(2);
+    ASSERT_TRUE(aligned(p1, 32));
+    ASSERT_TRUE(aligned(p2, 32));
+    x.construct(p2 + 1, vector4());
+    x.destroy(p2 + 1);
+    x.deallocate(p1, 1);
+    x.deallocate(p2, 2);
+    ASSERT_EQ(x[28], 344);
+}
+
+/** ---------------------------------------
+ * allocate_aligned() - vector and cache line alignment
+ * ---------------------------------------*/
+
+TEST(TestAllocator10, allocate_aligned_1) {
+    typedef Allocator<double, 1000>::pointer pointer;
+    Allocator<double, 1000> x;
+    x.allocate(1);
+    const pointer p1 = x.allocate_aligned(4, 32);
+    const pointer p2 = x.allocate_aligned(8, 64);
+    const pointer p3 = x.allocate_aligned(1, 8);
+    ASSERT_TRUE(aligned(p1, 32));
+    ASSERT_TRUE(aligned(p2, 64));
+    ASSERT_TRUE(aligned(p3, 8));
+    ASSERT_TRUE(x.valid());
+    x.deallocate(p2, 8);
+    x.deallocate(p1, 4);
+    x.deallocate(p3, 1);
+    ASSERT_TRUE(x.valid());
+}
+
+TEST(TestAllocator10, allocate_aligned_2) {
+    // The padding in front of the payload is split off as a free block,
+    // padding too small for one grows by the alignment, a first block of
+    // n bytes puts the next payload r bytes past a multiple of 64
+    typedef Allocator<int, 1000, first_fit, check_full> allocator_type;
+    typedef allocator_type::pointer pointer;
+    const int residues[] = {0, 32, 56};
+    const int paddings[] = {0, 32, 72};
+    for (int k = 0; k != 3; ++k) {
+        allocator_type x;
+        const int o = reinterpret_cast<std::size_t>(&x.a[0]) % 64;
+        int n = (((residues[k] - o - 12) % 64) + 64) % 64;
+        if (n < 8) {
+            n += 64;}
+        const pointer q = x.allocate(n / sizeof(int));
+        const pointer p = x.allocate_aligned(2, 64);
+        ASSERT_TRUE(aligned(p, 64));
+        const int i = 8 + n + paddings[k];
+        ASSERT_EQ(reinterpret_cast<char*>(p), &x.a[i + 4]);
+        ASSERT_EQ(x[i], -8);
+        ASSERT_EQ(x[8 + n], paddings[k] == 0 ? -8 : paddings[k] - 8);
+        x.deallocate(p, 2);
+        x.deallocate(q, n / sizeof(int));
+        ASSERT_EQ(x[0], 992);}
+}
+
+TEST(TestAllocator10, allocate_aligned_3) {
+    Allocator<int, 100> x;
+    ASSERT_THROW(x.allocate_aligned(1, 24), invalid_argument);
+    ASSERT_EQ(x.allocate_aligned(0, 64), nullptr);
+    ASSERT_EQ(x.allocate_aligned(20, 64), nullptr);
+}
+
+TEST(TestAllocator10, allocate_aligned_4) {
+    typedef Allocator<int, 2000, segregated_fit>::pointer pointer;
+    Allocator<int, 2000, segregated_fit> x;
+    pointer p[8];
+    for (int i = 0; i != 8; ++i) {
+        p[i] = x.allocate_aligned(i + 1, 64);
+        ASSERT_TRUE(aligned(p[i], 64));}
+    for (int i = 0; i != 8; ++i)
+        x.deallocate(p[i], i + 1);
+    ASSERT_EQ(x[0], 1992);
+}
+
+TEST(TestAllocator10, allocate_aligned_5) {
+    // Alignment 8 is less than the smallest block, padding of 4 grows
+    // by 8 twice, to 20
+    typedef Allocator<int, 100, first_fit, check_full>::pointer pointer;
+    Allocator<int, 100, first_fit, check_full> x;
+    const pointer p1 = x.allocate(1);
+    const pointer p2 = x.allocate_aligned(1, 8);
+    ASSERT_TRUE(aligned(p2, 8));
+    ASSERT_EQ(x[16], 12);
+    ASSERT_EQ(x[36], -8);
+    x.deallocate(p2, 1);
+    x.deallocate(p1, 1);
+    ASSERT_EQ(x[0], 92);
+}
+
+TEST(TestAllocator10, allocate_aligned_6) {
+    // Doubles from an arena aligned to 4, one of 2 or 3 ints in front of
+    // them puts the payload 4 bytes past a multiple of 8
+    typedef FixedArena<1000, 4, first_fit, check_full> arena_type;
+    for (int n = 2; n != 4; ++n) {
+        arena_type r;
+        ArenaAllocator<int, arena_type>    x(r);
+        ArenaAllocator<double, arena_type> y(x);
+        int*    p = x.allocate(n);
+        double* q = y.allocate(1);
+        double* v = y.allocate(3);
+        ASSERT_TRUE(aligned(q, 8));
+        ASSERT_TRUE(aligned(v, 8));
+        y.deallocate(q, 1);
+        x.deallocate(p, n);
+        y.deallocate(v, 3);
+        ASSERT_EQ(r.fragmentation(), 0.0);}
+}
+
+TEST(TestAllocator10, shared_align_1) {
+    typedef SharedAllocator<vector4, 4000>::pointer pointer;
+    SharedAllocator<vector4, 4000> x;
+    const pointer p1 = x.allocate(1);
+    const pointer p2 = x.allocate(3);
+    const pointer p3 = x.allocate(20);
+    ASSERT_TRUE(aligned(p1, 32));
+    ASSERT_TRUE(aligned(p2, 32));
+    ASSERT_TRUE(aligned(p3, 32));
+    x.deallocate(p1, 1);
+    x.deallocate(p2, 3);
+    x.deallocate(p3, 20);
+    x.flush();
+}
+
+
+/** ---------------------------------------
+ * operator ==() - a copy owns a copy of the pool
+ * ---------------------------------------*/
+
+TEST(TestAllocator11, equal_1) {
+    Allocator<int, 100> x;
+    Allocator<int, 100> y = x;
+    ASSERT_TRUE(x == x);
+    ASSERT_TRUE(x != y);
+}
+
+/** ---------------------------------------
+ * ArenaAllocator - handles sharing one arena
+ * ---------------------------------------*/
+
+TEST(TestAllocator11, arena_1) {
+    typedef FixedArena<1000>                 arena_type;
+    typedef ArenaAllocator<int, arena_type>  allocator_type;
+    typedef allocator_type::rebind<double>::other other_type;
+    arena_type     r;
+    allocator_type x(r);
+    allocator_type y = x;
+    other_type     z(x);
+    ASSERT_EQ(sizeof(x), sizeof(void*));
+    ASSERT_TRUE(x == y);
+    ASSERT_TRUE(x == z);
+
+    arena_type     s;
+    allocator_type w(s);
+    ASSERT_TRUE(x != w);
+
+    // One deallocates what the other allocated
+    double* p = z.allocate(3);
+    ASSERT_TRUE(aligned(p, alignof(double)));
+    other_type(y).deallocate(p, 3);
+    ASSERT_EQ(r.fragmentation(), 0.0);
+}
+
+TEST(TestAllocator11, arena_2) {
+    // Node containers of different types share one pool
+    typedef FixedArena<4000>                 arena_type;
+    arena_type r;
+    {
+    std::list<int, ArenaAllocator<int, arena_type> > x((ArenaAllocator<int, arena_type>(r)));
+    std::map<int, int, std::less<int>, ArenaAllocator<std::pair<const int, int>, arena_type> >
+        y((std::less<int>()), ArenaAllocator<std::pair<const int, int>, arena_type>(r));
+    for (int i = 0; i != 20; ++i) {
+        x.push_back(i);
+        y[i] = i * i;}
+    std::list<int, ArenaAllocator<int, arena_type> > z(x);
+    ASSERT_TRUE(z.get_allocator() == x.get_allocator());
+    ASSERT_TRUE(x == z);
+    ASSERT_EQ(y[7], 49);
+    x.clear();
+    ASSERT_EQ(z.size(), 20u);
+    }
+    ASSERT_TRUE(r.valid());
+    ASSERT_EQ(r.fragmentation(), 0.0);
+    ASSERT_EQ(r[12], 3976);
+}
+
+TEST(TestAllocator11, arena_3) {
+    typedef HeapArena<64> arena_type;
+    arena_type r(10000);
+    ASSERT_EQ(reinterpret_cast<std::size_t>(r.data()) % 64, 0u);
+    std::vector<int, ArenaAllocator<int, arena_type> > x((ArenaAllocator<int, arena_type>(r)));
+    for (int i = 0; i != 1000; ++i)
+        x.push_back(i);
+    ASSERT_EQ(x[999], 999);
+    ASSERT_THROW(x.reserve(5000), bad_alloc);
+    x.clear();
+    x.shrink_to_fit();
+    ASSERT_TRUE(r.valid());
+}
+
+TEST(TestAllocator11, arena_4) {
+    typedef MappedArena<> arena_type;
+    arena_type r(1 << 20);
+    std::list<std::string, ArenaAllocator<std::string, arena_type> > x((ArenaAllocator<std::string, arena_type>(r)));
+    for (int i = 0; i != 1000; ++i)
+        x.push_front(std::string(50, 'a' + (i % 26)));
+    ASSERT_EQ(x.back(), std::string(50, 'a'));
+    ASSERT_TRUE(r.valid());
+    x.clear();
+    ASSERT_EQ(r.fragmentation(), 0.0);
+}
+
+TEST(TestAllocator11, arena_5) {
+    ASSERT_THROW(HeapArena<>(8), bad_alloc);
+    typedef FixedArena<100, 16, segregated_fit, check_local> arena_type;
+    arena_type r;
+    ArenaAllocator<char, arena_type> x(r);
+    ASSERT_THROW(x.allocate(100), bad_alloc);
+    char* p = x.allocate(64);
+    ASSERT_TRUE(aligned(p, 16));
+    x.deallocate(p, 64);
+}
+
+/** ---------------------------------------
+ * compact_tags - tags as narrow as N allows
+ * ---------------------------------------*/
+
+TEST(TestAllocator12, compact_1) {
+    ASSERT_TRUE((std::is_same<compact_tags<100>::tag,     std::uint16_t>::value));
+    ASSERT_TRUE((std::is_same<compact_tags<100>::link,    std::int16_t>::value));
+    ASSERT_TRUE((std::is_same<compact_tags<40000>::tag,   std::uint16_t>::value));
+    ASSERT_TRUE((std::is_same<compact_tags<40000>::link,  std::int32_t>::value));
+    ASSERT_TRUE((std::is_same<compact_tags<100000>::tag,  std::uint32_t>::value));
+    ASSERT_TRUE((std::is_same<compact_tags<100000>::link, std::int32_t>::value));
+}
+
+TEST(TestAllocator12, compact_5) {
+    // A pool sized at run time must fit in the tags and links
+    typedef HeapArena<4, first_fit, check_full, compact_tags<100> >   arena_type_1;
+    typedef HeapArena<4, first_fit, check_full, compact_tags<40000> > arena_type_2;
+    ASSERT_TRUE(compact_tags<100>::capacity    == 32767u);
+    ASSERT_TRUE(compact_tags<40000>::capacity  == 65535u);
+    ASSERT_TRUE(compact_tags<100000>::capacity == 2147483647u);
+    ASSERT_NO_THROW(arena_type_1(32767));
+    ASSERT_THROW(arena_type_1(32768),  bad_alloc);
+    ASSERT_THROW(arena_type_1(100000), bad_alloc);
+    ASSERT_NO_THROW(arena_type_2(65535));
+    ASSERT_THROW(arena_type_2(65536),  bad_alloc);
+}
+
+/** ---------------------------------------
+ * compact_tags - no footer on busy blocks
+ * ---------------------------------------*/
+
+TEST(TestAllocator12, compact_2) {
+    typedef Allocator<int, 100, first_fit, default_check, compact_tags<100> > allocator_type;
+    typedef allocator_type::pointer pointer;
+    allocator_type x;
+
+    // A 2 byte front tag holding the length of the block, payload at 4
+    ASSERT_EQ(x[2], 96);
+
+    // An int takes 8 bytes, the busy bit is set
+    const pointer p1 = x.allocate(1);
+    const pointer p2 = x.allocate(1);
+    ASSERT_EQ(reinterpret_cast<char*>(p1), x.a + 4);
+    ASSERT_EQ(reinterpret_cast<char*>(p2), x.a + 12);
+    ASSERT_EQ(x[2],  9);
+    ASSERT_EQ(x[10], 9);
+    ASSERT_EQ(x[18], 80);
+
+    // The block after a free one knows it, the free one has a back tag
+    x.deallocate(p1, 1);
+    ASSERT_EQ(x[2],  8);
+    ASSERT_EQ(x[8],  8);
+    ASSERT_EQ(x[10], 11);
+    ASSERT_TRUE(x.valid());
+
+    // Coalesced with both neighbours
+    x.deallocate(p2, 1);
+    ASSERT_EQ(x[2], 96);
+    ASSERT_TRUE(x.valid());
+}
+
+TEST(TestAllocator12, compact_3) {
+    typedef Allocator<int, 200, best_fit, check_local, compact_tags<200> > allocator_type;
+    typedef allocator_type::pointer pointer;
+    allocator_type x;
+    pointer p[8];
+    for (int i = 0; i != 8; ++i)
+        p[i] = x.allocate(1 + (i % 3));
+    x.deallocate(p[1], 2);
+    x.deallocate(p[3], 1);
+    x.deallocate(p[2], 3);
+    ASSERT_TRUE(x.valid());
+    ASSERT_THROW(x.deallocate(p[2], 3), invalid_argument);
+    x.deallocate(p[7], 2);
+    x.deallocate(p[0], 1);
+    x.deallocate(p[5], 3);
+    x.deallocate(p[4], 2);
+    x.deallocate(p[6], 1);
+    ASSERT_TRUE(x.valid());
+    ASSERT_EQ(x.fragmentation(), 0.0);
+    ASSERT_EQ(x[2], 196);
+}
+
+TEST(TestAllocator12, compact_4) {
+    // 4 byte tags above 64K, still no footer on busy blocks
+    typedef Allocator<int, 70000, segregated_fit, check_local, compact_tags<70000> > allocator_type;
+    typedef allocator_type::pointer pointer;
+    std::unique_ptr<allocator_type> x(new allocator_type);
+    ASSERT_EQ((*x)[0], 70000);
+    const pointer p1 = x->allocate(1);
+    const pointer p2 = x->allocate(1000);
+    ASSERT_EQ((*x)[0], 16 | 1);
+    ASSERT_EQ(reinterpret_cast<char*>(p2), x->a + 20);
+    x->deallocate(p1, 1);
+    ASSERT_EQ((*x)[16], 4004 | 1 | 2);
+    x->deallocate(p2, 1000);
+    ASSERT_TRUE(x->valid());
+    ASSERT_EQ((*x)[0], 70000);
+}
+
+/** ---------------------------------------
+ * compact_tags - more objects fit in N
+ * ---------------------------------------*/
+
+template <typename A>
+int fill (A& x, std::size_t n) {
+    int count = 0;
+    while (x.allocate(n) != nullptr)
+        ++count;
+    return count;}
+
+TEST(TestAllocator12, overhead_1) {
+    Allocator<int, 1000> x;
+    Allocator<int, 1000, first_fit, check_none, compact_tags<1000> > y;
+    // 16 bytes a single int before, 8 after
+    ASSERT_EQ(fill(x, 1), 62);
+    ASSERT_EQ(fill(y, 1), 124);
+}
+
+TEST(TestAllocator12, overhead_2) {
+    Allocator<int, 1000> x;
+    Allocator<int, 1000, first_fit, check_none, compact_tags<1000> > y;
+    // 20 bytes three ints before, 16 after
+    ASSERT_EQ(fill(x, 3), 50);
+    ASSERT_EQ(fill(y, 3), 62);
+}
+
+TEST(TestAllocator12, overhead_3) {
+    typedef FixedArena<4000, 4, first_fit, check_full, compact_tags<4000> > arena_type;
+    arena_type r;
+    ArenaAllocator<int, arena_type> x(r);
+    std::vector<int*> v;
+    // 400 ints fit where boundary tags would fit 250
+    for (int i = 0; i != 400; ++i)
+        v.push_back(x.allocate(1));
+    ASSERT_THROW(x.allocate(200), bad_alloc);
+    for (int i = 0; i < 400; i += 2)
+        x.deallocate(v[i], 1);
+    for (int i = 1; i < 400; i += 2)
+        x.deallocate(v[i], 1);
+    ASSERT_EQ(r.fragmentation(), 0.0);
+}
+
+/** ---------------------------------------
+ * try_expand() - grows into the free block after it
+ * ---------------------------------------*/
+
+TEST(TestAllocator13, expand_1) {
+    typedef Allocator<int, 100>::pointer pointer;
+    Allocator<int, 100> x;
+    const pointer p = x.allocate(2);
+    ASSERT_TRUE(x.try_expand(p, 5));
+    ASSERT_EQ(x[0],  -20);
+    ASSERT_EQ(x[24], -20);
+    ASSERT_EQ(x[28],  64);
+
+    // What would be left can not hold a free block, absorb all of it
+    ASSERT_TRUE(x.try_expand(p, 22));
+    ASSERT_EQ(x[0],  -92);
+    ASSERT_EQ(x.free_list.head, -1);
+    ASSERT_FALSE(x.try_expand(p, 24));
+    x.deallocate(p, 22);
+    ASSERT_EQ(x[0], 92);
+}
+
+TEST(TestAllocator13, expand_2) {
+    typedef Allocator<int, 100>::pointer pointer;
+    Allocator<int, 100> x;
+    const pointer p1 = x.allocate(2);
+    const pointer p2 = x.allocate(2);
+    ASSERT_FALSE(x.try_expand(p1, 3));
+    ASSERT_EQ(x[0], -8);
+    ASSERT_THROW(x.try_expand(p1 + 1, 3), invalid_argument);
+    x.deallocate(p2, 2);
+    ASSERT_TRUE(x.try_expand(p1, 3));
+    ASSERT_TRUE(x.valid());
+}
+
+/** ---------------------------------------
+ * try_expand() - shrinks by splitting off a free tail
+ * ---------------------------------------*/
+
+TEST(TestAllocator13, shrink_1) {
+    typedef Allocator<int, 100>::pointer pointer;
+    Allocator<int, 100> x;
+    const pointer p = x.allocate(10);
+    ASSERT_EQ(x[0], -40);
+    ASSERT_EQ(x.reallocate(p, 10, 2), p);
+    ASSERT_EQ(x[0], -8);
+    ASSERT_EQ(x[12], -8);
+    // The tail coalesced with the free block after it
+    ASSERT_EQ(x[16], 76);
+    ASSERT_TRUE(x.valid());
+}
+
+TEST(TestAllocator13, shrink_2) {
+    // A tail of 4 bytes can not hold a free block, the block keeps it
+    typedef Allocator<int, 100>::pointer pointer;
+    Allocator<int, 100> x;
+    const pointer p1 = x.allocate(3);
+    x.allocate(1);
+    ASSERT_TRUE(x.try_expand(p1, 2));
+    ASSERT_EQ(x[0], -12);
+    ASSERT_TRUE(x.valid());
+}
+
+/** ---------------------------------------
+ * reallocate() - moves only when it must
+ * ---------------------------------------*/
+
+TEST(TestAllocator13, reallocate_1) {
+    typedef Allocator<int, 200>::pointer pointer;
+    Allocator<int, 200> x;
+    pointer p1 = x.allocate(2);
+    const pointer p2 = x.allocate(2);
+    p1[0] = 5;
+    p1[1] = 6;
+    const pointer p3 = x.reallocate(p1, 2, 4);
+    ASSERT_NE(p3, p1);
+    ASSERT_EQ(p3[0], 5);
+    ASSERT_EQ(p3[1], 6);
+    ASSERT_EQ(x[0], 8);
+
+    // No block fits, the old one is left alone
+    ASSERT_EQ(x.reallocate(p2, 2, 40), nullptr);
+    ASSERT_EQ(x[16], -8);
+    ASSERT_EQ(x.reallocate(p2, 2, 0), nullptr);
+    ASSERT_EQ(x.reallocate(nullptr, 0, 1), reinterpret_cast<pointer>(x.a + 4));
+    ASSERT_TRUE(x.valid());
+}
+
+TEST(TestAllocator13, reallocate_2) {
+    // A buffer growing one object at a time never moves
+    typedef Allocator<int, 200>::pointer pointer;
+    Allocator<int, 200> x;
+    pointer p = x.allocate(1);
+    p[0] = 0;
+    for (int n = 2; n != 40; ++n) {
+        ASSERT_EQ(x.reallocate(p, n - 1, n), p);
+        p[n - 1] = n - 1;}
+    for (int n = 0; n != 39; ++n)
+        ASSERT_EQ(p[n], n);
+    x.deallocate(p, 39);
+    ASSERT_EQ(x[0], 192);
+}
+
+TEST(TestAllocator13, reallocate_3) {
+    typedef Allocator<int, 200, next_fit, check_local, compact_tags<200> > allocator_type;
+    typedef allocator_type::pointer pointer;
+    allocator_type x;
+    pointer p1 = x.allocate(1);
+    const pointer p2 = x.allocate(1);
+    x.deallocate(p2, 1);
+    ASSERT_EQ(x.reallocate(p1, 1, 10), p1);
+    const pointer p3 = x.allocate(1);
+    ASSERT_EQ(x.reallocate(p1, 10, 1), p1);
+    // The free tail knows the block before it is busy, p3 knows it is free
+    ASSERT_TRUE(x.valid());
+    x.deallocate(p3, 1);
+    x.deallocate(p1, 1);
+    ASSERT_EQ(x.fragmentation(), 0.0);
+}
+
+TEST(TestAllocator13, reallocate_4) {
+    typedef FixedArena<1000, 4, segregated_fit> arena_type;
+    arena_type r;
+    ArenaAllocator<int, arena_type> x(r);
+    int* p = x.allocate(10);
+    int* q = x.allocate(10);
+    ASSERT_THROW(x.reallocate(p, 10, 1000), bad_alloc);
+    p[9] = 9;
+    p = x.reallocate(p, 10, 20);
+    ASSERT_EQ(p[9], 9);
+    ASSERT_TRUE(x.try_expand(p, 100));
+    x.deallocate(q, 10);
+    x.deallocate(p, 100);
+    ASSERT_EQ(r.fragmentation(), 0.0);
+}
+
+TEST(TestAllocator13, interior_1) {
+    // A pointer inside a block finds an unaligned length where its front
+    // tag would be, and is refused before the back tag it names is read
+    typedef Allocator<int, 100, first_fit, check_full>::pointer pointer;
+    Allocator<int, 100, first_fit, check_full> x;
+    const pointer p = x.allocate(5);
+    p[1] = -6;
+    ASSERT_THROW(x.deallocate(p + 2, 3), invalid_argument);
+    ASSERT_THROW(x.try_expand(p + 2, 1), invalid_argument);
+    p[1] = 6;
+    ASSERT_THROW(x.deallocate(p + 2, 3), invalid_argument);
+    x.deallocate(p, 5);
+    ASSERT_EQ(x.fragmentation(), 0.0);
+}
+
+/** ---------------------------------------
+ * SlabAllocator - small objects from slabs
+ * ---------------------------------------*/
+
+TEST(TestAllocator14, slab_1) {
+    typedef FixedArena<2000>                 arena_type;
+    typedef SlabArena<arena_type, 256>       slab_type;
+    typedef SlabAllocator<int, slab_type>    allocator_type;
+    typedef allocator_type::pointer          pointer;
+    arena_type r;
+    {
+    slab_type      s(r);
+    allocator_type x(s);
+    const pointer p1 = x.allocate(1);
+    const pointer p2 = x.allocate(1);
+
+    // Adjacent slots of 4 bytes, no header between them, in a slab on a
+    // multiple of 256
+    ASSERT_EQ(p2, p1 + 1);
+    ASSERT_EQ(reinterpret_cast<std::size_t>(slab_type::slab_of(reinterpret_cast<char*>(p1))) % 256, 0u);
+    ASSERT_EQ(slab_type::slab_of(reinterpret_cast<char*>(p2)), s.partial[0]);
+    ASSERT_EQ(s.partial[0]->used, 2);
+    ASSERT_TRUE(s.valid());
+
+    // The empty slab is kept as the spare of its class, and used again
+    x.deallocate(p1, 1);
+    x.deallocate(p2, 1);
+    ASSERT_EQ(s.partial[0], nullptr);
+    ASSERT_EQ(s.spare[0], slab_type::slab_of(reinterpret_cast<char*>(p1)));
+    ASSERT_TRUE(s.valid());
+    ASSERT_EQ(x.allocate(1), p1);
+    ASSERT_EQ(s.spare[0], nullptr);
+    x.deallocate(p1, 1);
+    ASSERT_GT(r.fragmentation(), 0.0);
+    }
+
+    // The spare goes back to the arena with the slab arena
+    ASSERT_EQ(r.fragmentation(), 0.0);
+}
+
+TEST(TestAllocator14, slab_2) {
+    typedef FixedArena<4000>                 arena_type;
+    typedef SlabArena<arena_type, 256>       slab_type;
+    typedef SlabAllocator<double, slab_type> allocator_type;
+    typedef allocator_type::pointer          pointer;
+    arena_type     r;
+    slab_type      s(r);
+    allocator_type x(s);
+    std::vector<pointer> v;
+    do
+        v.push_back(x.allocate(1));
+    while (s.partial[1] != nullptr);
+
+    // A full slab leaves the list, the next object starts a new one
+    const char* first = reinterpret_cast<char*>(v.front());
+    ASSERT_EQ(static_cast<int>(v.size()), slab_type::slab_of(first)->slots);
+    v.push_back(x.allocate(1));
+    ASSERT_NE(slab_type::slab_of(reinterpret_cast<char*>(v.back())), slab_type::slab_of(first));
+    ASSERT_EQ(s.partial[1], slab_type::slab_of(reinterpret_cast<char*>(v.back())));
+
+    // Freeing one slot puts the full slab back on the list
+    x.deallocate(v[3], 1);
+    ASSERT_EQ(s.partial[1], slab_type::slab_of(first));
+    v[3] = x.allocate(1);
+    ASSERT_EQ(v[3], v[0] + 3);
+    ASSERT_TRUE(s.valid());
+
+    // The first slab to empty is the spare, the other goes back
+    for (std::size_t i = 0; i != v.size(); ++i)
+        x.deallocate(v[i], 1);
+    ASSERT_EQ(s.spare[1], slab_type::slab_of(first));
+    ASSERT_TRUE(s.valid());
+    s.release();
+    ASSERT_EQ(r.fragmentation(), 0.0);
+}
+
+TEST(TestAllocator14, slab_3) {
+    typedef FixedArena<2000>                 arena_type;
+    typedef SlabArena<arena_type, 256>       slab_type;
+    typedef SlabAllocator<int, slab_type>    allocator_type;
+    typedef allocator_type::pointer          pointer;
+    arena_type     r;
+    slab_type      s(r);
+    allocator_type x(s);
+    const pointer p1 = x.allocate(1);
+    const pointer p2 = x.allocate(1);
+    x.deallocate(p1, 1);
+    ASSERT_THROW(x.deallocate(p1, 1), invalid_argument);
+    ASSERT_THROW(x.deallocate(p2 + 1, 1), invalid_argument);
+    ASSERT_THROW(x.deallocate(p2, 3), invalid_argument);
+    int y = 0;
+    ASSERT_THROW(x.deallocate(&y, 1), invalid_argument);
+    x.deallocate(p2, 1);
+    ASSERT_TRUE(s.valid());
+}
+
+TEST(TestAllocator14, slab_4) {
+    // Big requests go to the arena, small ones of any type to the slabs
+    // of their size class, rebound handles share the slabs
+    typedef FixedArena<2000>                 arena_type;
+    typedef SlabArena<arena_type, 256>       slab_type;
+    typedef SlabAllocator<int, slab_type>    allocator_type;
+    typedef allocator_type::pointer          pointer;
+    arena_type     r;
+    slab_type      s(r);
+    allocator_type x(s);
+    SlabAllocator<double, slab_type> y(x);
+    ASSERT_TRUE(x == y);
+    const pointer p1 = x.allocate(100);
+    const pointer p2 = x.allocate(1);
+    double*       p3 = y.allocate(2);
+    ASSERT_NE(slab_type::slab_of(reinterpret_cast<char*>(p1)), slab_type::slab_of(reinterpret_cast<char*>(p2)));
+    ASSERT_EQ(s.partial[3], slab_type::slab_of(reinterpret_cast<char*>(p3)));
+    x.construct(p2, 7);
+    ASSERT_EQ(*p2, 7);
+    x.destroy(p2);
+    x.deallocate(p2, 1);
+    y.deallocate(p3, 2);
+    x.deallocate(p1, 100);
+    ASSERT_THROW(x.allocate(1000), bad_alloc);
+    ASSERT_TRUE(s.valid());
+    s.release();
+    ASSERT_EQ(r.fragmentation(), 0.0);
+}
+
+TEST(TestAllocator14, slab_5) {
+    // Slots of 4 bytes with no tags, in adjacent slabs, hold more than
+    // three times as many ints as blocks of 16 bytes
+    typedef FixedArena<16384>                arena_type;
+    typedef SlabArena<arena_type>            slab_type;
+    arena_type r1;
+    arena_type r2;
+    slab_type  s(r2);
+    int blocks = 0;
+    while (r1.allocate_bytes(sizeof(int), alignof(int)) != nullptr)
+        ++blocks;
+    int slots = 0;
+    while (s.allocate_bytes(sizeof(int), alignof(int)) != nullptr)
+        ++slots;
+    ASSERT_EQ(blocks, 1023);
+    ASSERT_EQ(slots,  14 * 238);
+    ASSERT_GT(slots,  3 * blocks);
+    ASSERT_TRUE(s.valid());
+}
+
+TEST(TestAllocator14, slab_6) {
+    // The nodes of a list and a map come from the slabs
+    typedef HeapArena<>                      arena_type;
+    typedef SlabArena<arena_type>            slab_type;
+    arena_type r(1 << 18);
+    slab_type  s(r);
+    std::list<int, SlabAllocator<int, slab_type> > x((SlabAllocator<int, slab_type>(s)));
+    std::map<int, int, std::less<int>, SlabAllocator<std::pair<const int, int>, slab_type> >
+        y((std::less<int>()), SlabAllocator<std::pair<const int, int>, slab_type>(s));
+    for (int i = 0; i != 1000; ++i) {
+        x.push_back(i);
+        y[i] = 2 * i;}
+    std::list<int, SlabAllocator<int, slab_type> > z(x);
+    ASSERT_TRUE(z.get_allocator() == y.get_allocator());
+    ASSERT_EQ(z.size(), 1000u);
+    ASSERT_EQ(y[999], 1998);
+    ASSERT_TRUE(s.valid());
+
+    x.clear();
+    y.clear();
+    z.clear();
+    ASSERT_TRUE(s.valid());
+    s.release();
+    ASSERT_EQ(r.fragmentation(), 0.0);
+}
+
+/** ---------------------------------------
+ * statistics() - counters and the block walk
+ * ---------------------------------------*/
+
+TEST(TestAllocator15, stats_1) {
+    typedef Allocator<int, 100, first_fit, check_full, boundary_tags, counting_stats> allocator_type;
+    typedef allocator_type::pointer pointer;
+    allocator_type x;
+    const pointer p1 = x.allocate(2);
+    const pointer p2 = x.allocate(5);
+    heap_stats r = x.statistics();
+    ASSERT_EQ(r.allocations,  2);
+    ASSERT_EQ(r.frees,        0);
+    ASSERT_EQ(r.bytes_in_use, 28);
+    ASSERT_EQ(r.high_water,   28);
+    ASSERT_EQ(r.free_blocks,  1);
+    ASSERT_EQ(r.largest_free, 48);
+    ASSERT_EQ(r.fragmentation, 0.0);
+
+    x.deallocate(p1, 2);
+    r = x.statistics();
+    ASSERT_EQ(r.frees,        1);
+    ASSERT_EQ(r.bytes_in_use, 20);
+    ASSERT_EQ(r.high_water,   28);
+    ASSERT_EQ(r.free_blocks,  2);
+    ASSERT_EQ(r.largest_free, 48);
+    ASSERT_DOUBLE_EQ(r.fragmentation, 1.0 - (48.0 / 56.0));
+
+    x.deallocate(p2, 5);
+    r = x.statistics();
+    ASSERT_EQ(r.bytes_in_use, 0);
+    ASSERT_EQ(r.free_blocks,  1);
+    ASSERT_EQ(r.largest_free, 92);
+}
+
+TEST(TestAllocator15, stats_2) {
+    // How many blocks each scan visited
+    typedef Allocator<int, 100, first_fit, check_none, boundary_tags, counting_stats> allocator_type;
+    typedef allocator_type::pointer pointer;
+    allocator_type x;
+    pointer p[5];
+    for (int i = 0; i != 5; ++i)
+        p[i] = x.allocate(1);
+    x.deallocate(p[0], 1);
+    x.deallocate(p[2], 1);
+    ASSERT_EQ(x.allocate(10), nullptr);
+    const heap_stats r = x.statistics();
+    ASSERT_EQ(r.scans[0], 0);
+    ASSERT_EQ(r.scans[1], 5);
+    ASSERT_EQ(r.scans[2], 1);
+    ASSERT_EQ(r.free_blocks, 3);
+}
+
+TEST(TestAllocator15, stats_3) {
+    typedef Allocator<int, 100, segregated_fit, check_none, compact_tags<100>, counting_stats> allocator_type;
+    typedef allocator_type::pointer pointer;
+    allocator_type x;
+    const pointer p = x.allocate(1);
+    ASSERT_TRUE(x.try_expand(p, 10));
+    ASSERT_TRUE(x.try_expand(p, 2));
+    const heap_stats r = x.statistics();
+    ASSERT_EQ(r.allocations,  1);
+    ASSERT_EQ(r.bytes_in_use, 10);
+    ASSERT_EQ(r.high_water,   42);
+    ASSERT_EQ(r.scans[1],     1);
+}
+
+TEST(TestAllocator15, stats_4) {
+    // Not counting costs no space
+    struct heap_arena {
+        first_fit               free_list;
+        check_none              check;
+        int                     limit;
+        std::unique_ptr<char[]> buffer;
+        char*                   a;};
+    ASSERT_TRUE(std::is_empty<no_stats>::value);
+    ASSERT_EQ(sizeof(HeapArena<16, first_fit, check_none, boundary_tags, no_stats>), sizeof(heap_arena));
+}
+
+/** ---------------------------------------
+ * dump() - the block map
+ * ---------------------------------------*/
+
+TEST(TestAllocator15, dump_1) {
+    Allocator<int, 100> x;
+    const Allocator<int, 100>::pointer p = x.allocate(2);
+    x.allocate(1);
+    x.deallocate(p, 2);
+    std::ostringstream out;
+    x.dump(out);
+    ASSERT_EQ(out.str(), "0 free 8\n16 busy 8\n32 free 60\n");
+}
+
+/** ---------------------------------------
+ * trace - read, write, replay
+ * ---------------------------------------*/
+
+TEST(TestAllocator16, trace_1) {
+    std::istringstream in("# two blocks\na 0 16\n\na 1 40\nf 0\nf 1\na 0 8\n");
+    const std::vector<trace_op> ops = read_trace(in);
+    ASSERT_EQ(ops.size(), 5u);
+    ASSERT_EQ(ops[1].kind,  'a');
+    ASSERT_EQ(ops[1].id,    1);
+    ASSERT_EQ(ops[1].bytes, 40u);
+    ASSERT_EQ(ops[2].kind,  'f');
+    std::ostringstream out;
+    write_trace(out, ops);
+    ASSERT_EQ(out.str(), "a 0 16\na 1 40\nf 0\nf 1\na 0 8\n");
+}
+
+TEST(TestAllocator16, trace_2) {
+    std::istringstream in1("a 0\n");
+    ASSERT_THROW(read_trace(in1), invalid_argument);
+    std::istringstream in2("x 0 8\n");
+    ASSERT_THROW(read_trace(in2), invalid_argument);
+    std::istringstream in3("f 0 8\n");
+    ASSERT_THROW(read_trace(in3), invalid_argument);
+    std::istringstream in4("a 0 8\na 0 8\n");
+    ASSERT_THROW(read_trace(in4), invalid_argument);
+    std::istringstream in5("a 0 8\nf 1\n");
+    ASSERT_THROW(read_trace(in5), invalid_argument);
+}
+
+TEST(TestAllocator16, replay_1) {
+    // The second block does not fit, its free is skipped, the rest are
+    // freed at the end
+    std::istringstream in("a 0 40\na 1 80\na 2 8\nf 1\nf 0\na 1 4\n");
+    Allocator<char, 100>        x;
+    const Allocator<char, 100>& y = x;
+    int busy = 0;
+    const replay_result r = replay(x, read_trace(in), [&] () {
+        busy = y[0];});
+    ASSERT_EQ(r.operations, 5);
+    ASSERT_EQ(r.failures,   1);
+    ASSERT_LE(r.p50, r.p99);
+    ASSERT_LE(r.p99, r.max);
+    ASSERT_EQ(busy, -8);
+    ASSERT_EQ(y[0], 92);
+}